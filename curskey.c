@@ -17,15 +17,28 @@
  */
 
 #include "curskey.h"
+#include <termcap.h> // tputs(), without the capability macros of <term.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <strings.h>
-#include <inttypes.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#ifdef CURSKEY_THREAD
+#include <fcntl.h>
+#include <pthread.h>
+#endif
 
 #ifdef __cplusplus
 #define STATIC_CAST(TYPE, VALUE)      static_cast<TYPE>(VALUE)
+#define REINTERPRET_CAST(TYPE, VALUE) reinterpret_cast<TYPE>(VALUE)
 #else
 #define STATIC_CAST(TYPE, VALUE)      ((TYPE)(VALUE))
+#define REINTERPRET_CAST(TYPE, VALUE) ((TYPE)(VALUE))
 #endif
 
 #define UPPER(CHAR) (CHAR & ~0x20)
@@ -35,6 +48,204 @@ static void define_xterm_keys()          CURSES_LIB_NOEXCEPT;
 static void define_rxvt_key(char, int)   CURSES_LIB_NOEXCEPT;
 static void define_rxvt_arrow(char, int) CURSES_LIB_NOEXCEPT;
 static void define_rxvt_func_keys()      CURSES_LIB_NOEXCEPT;
+static int  curskey_meta_key(int, int)    CURSES_LIB_NOEXCEPT;
+const char* curskey_keyname(int)         CURSES_LIB_NOEXCEPT;
+static int  curskey_decoder_wgetch(struct curskey_ctx*, WINDOW*, int) CURSES_LIB_NOEXCEPT;
+static int  curskey_wdelay(WINDOW*)         CURSES_LIB_NOEXCEPT;
+static void curskey_record_bytes(struct curskey_ctx*, const void*, size_t) CURSES_LIB_NOEXCEPT;
+
+#ifdef CURSKEY_LATENCY
+static void curskey_latency_arrive(struct curskey_ctx*) CURSES_LIB_NOEXCEPT;
+static void curskey_latency_take(struct curskey_ctx*, const unsigned char*, int) CURSES_LIB_NOEXCEPT;
+static void curskey_latency_done(struct curskey_ctx*) CURSES_LIB_NOEXCEPT;
+#define CURSKEY_LATENCY_ARRIVE(CTX)     curskey_latency_arrive(CTX)
+#define CURSKEY_LATENCY_TAKE(CTX, S, N) curskey_latency_take(CTX, S, N)
+#define CURSKEY_LATENCY_DONE(CTX)       curskey_latency_done(CTX)
+#else
+#define CURSKEY_LATENCY_ARRIVE(CTX)     ((void) 0)
+#define CURSKEY_LATENCY_TAKE(CTX, S, N) ((void) 0)
+#define CURSKEY_LATENCY_DONE(CTX)       ((void) 0)
+#endif
+
+#define CURSKEY_OPT_ALL (CURSKEY_OPT_DECODER|CURSKEY_OPT_PASTE|CURSKEY_OPT_KITTY \
+	|CURSKEY_OPT_MODIFY_OTHER_KEYS|CURSKEY_OPT_ADAPTIVE_ESCDELAY|CURSKEY_OPT_MOUSE \
+	|CURSKEY_OPT_FOCUS|CURSKEY_OPT_RESIZE|CURSKEY_OPT_UTF8)
+// Options that are implemented by the decoder
+#define CURSKEY_OPT_DECODED (CURSKEY_OPT_PASTE|CURSKEY_OPT_KITTY|CURSKEY_OPT_MODIFY_OTHER_KEYS \
+	|CURSKEY_OPT_ADAPTIVE_ESCDELAY|CURSKEY_OPT_MOUSE|CURSKEY_OPT_FOCUS|CURSKEY_OPT_RESIZE \
+	|CURSKEY_OPT_UTF8)
+// Options that make the terminal report keys as extended keycodes
+#define CURSKEY_OPT_EXT_KEYS (CURSKEY_OPT_KITTY|CURSKEY_OPT_MODIFY_OTHER_KEYS)
+#define CURSKEY_MOD_ALL \
+	(CURSKEY_MOD_SHIFT|CURSKEY_MOD_META|CURSKEY_MOD_CTRL|CURSKEY_MOD_SUPER|CURSKEY_MOD_HYPER)
+#define CURSKEY_EXT_MOD_SHIFT 12 // Position of the modifiers in extended keycodes
+
+#define CURSKEY_SEQ_MAX   16  // Longest escape sequence kept in the table
+#define CURSKEY_SEQS_MAX  512 // Maximum number of escape sequences
+
+// Escape sequence that is bound to a keycode
+struct curskey_seq {
+	unsigned char seq[CURSKEY_SEQ_MAX];
+	int len;
+	int keycode;
+};
+
+// Escape sequences and single bytes bound to keycodes
+struct curskey_seqtab {
+	const struct curskey_seq *seqs; // Sorted by curskey_seq_sort_compare()
+	int count;
+	const int *byte_keys;           // 256 keycodes, NULL for the defaults
+	unsigned int options;           // CURSKEY_OPT_ flags of the protocols to decode
+};
+
+// Everything that belongs to one terminal session. The functions without
+// the _ctx suffix use the default context. All zero is the initial state,
+// so the default context needs no setup.
+struct curskey_ctx {
+	int key_return;       // See curskey_return(), unused by the default context
+	unsigned int options; // Set by curskey_enable_ctx()
+	FILE *output;         // Receives the mode switches of the options, stdout if NULL
+
+	// Keys of the terminal, loaded from terminfo by curskey_load_seqs()
+	struct curskey_seqtab seqtab;
+	struct curskey_seq seqs[CURSKEY_SEQS_MAX];
+	int byte_keys[256];
+
+	// Read-ahead buffer of the decoder, shared by all windows of the terminal
+	struct {
+		int fd;           // STDIN_FILENO, that is zero, by default
+		int rows, cols;   // Last known terminal size
+		int pos;          // Start of the pending bytes
+		int len;          // Number of pending bytes
+		int waiting;      // Bytes of an incomplete sequence seen by curskey_drain()
+		long since;       // When curskey_drain() first saw them
+		unsigned char buf[CURSKEY_INPUT_BUFSIZE];
+	} input;
+
+	// Keys that curskey_wget_wch() or curskey_wgetch_repeat() read from
+	// curses beyond a key, taken again before calling wgetch(). Last in
+	// first out like ungetch().
+	struct {
+		int keys[4];
+		int len;
+	} unread;
+
+	// Text of the last bracketed paste
+	struct {
+		char *buf;
+		size_t len;
+		size_t size;
+		size_t scanned;  // Bytes searched for the end of the paste
+		int active;      // The paste is still being collected
+		long since;      // Last time the paste made progress
+	} pasted;
+
+	// Adaptive ESC delay, estimated from the gaps inside of escape sequences
+	struct {
+		int delay;     // Current delay in milliseconds, if `samples` is non-zero
+		int gap;       // Smoothed gap
+		int var;       // Smoothed deviation of the gap
+		int samples;   // Number of gaps measured
+		long timeout;  // Start of the wait for a lone ESC that timed out, 0 if none
+	} escwait;
+
+#ifdef CURSKEY_LATENCY
+	// Latency of the decoded keys, see curskey_latency_ctx()
+	struct {
+		long since;      // Arrival of the oldest pending byte in microseconds
+		long newest;     // Arrival of the last chunk of input
+		int  mark;       // Number of pending bytes that arrived before `newest`
+		long arrival;    // Arrival of the first byte of the key being returned
+		int  key_class;  // Class of that key
+		int  taken;      // A key was taken and its latency is not counted yet
+		long counts[CURSKEY_LATENCY_CLASSES][CURSKEY_LATENCY_BUCKETS];
+	} latency;
+#endif
+
+#ifdef CURSKEY_THREAD
+	// Input thread and its queue of keys, see curskey_thread_start_ctx().
+	// The thread only writes `head`, the consumer only writes `tail`.
+	struct {
+		pthread_t thread;
+		int running;
+		int stop;        // Set before waking the thread to make it stop
+		int wake[2];     // Wakes the thread to stop, or when the full queue got room
+		int notify[2];   // Readable when keys were queued
+		unsigned int head;
+		char pad1[64 - sizeof(unsigned int)];
+		unsigned int tail;
+		char pad2[64 - sizeof(unsigned int)];
+		struct curskey_event events[CURSKEY_THREAD_QUEUE];
+	} thread;
+#endif
+
+	// Recording of the input, see curskey_record_ctx()
+	struct {
+		int active; // Recording to `fd`
+		int fd;
+		long last;  // Time of the previous record in microseconds
+	} record;
+
+	int last_id;                        // Color pairs created so far
+	int color_pairs[CURSES_LIB_COLORS];
+
+	char keydef[128]; // Result of curskey_get_keydef_ctx()
+	char color[8];    // Result of curses_color_tostring_ctx()
+};
+
+static struct curskey_ctx curskey_default_ctx;
+
+/* ============================================================================
+ * Context functions ==========================================================
+ * ==========================================================================*/
+
+/// Return the context used by the functions without the _ctx suffix
+static struct curskey_ctx* curskey_default()
+	CURSES_LIB_NOEXCEPT
+{
+	return &curskey_default_ctx;
+}
+
+/// Return the keycode of RETURN of a context, the default context uses the
+/// global variable **KEY_RETURN**
+static int* curskey_return(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	return (ctx == &curskey_default_ctx ? &KEY_RETURN : &ctx->key_return);
+}
+
+struct curskey_ctx* curskey_ctx_default()
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_default();
+}
+
+struct curskey_ctx* curskey_ctx_new()
+	CURSES_LIB_NOEXCEPT
+{
+	struct curskey_ctx *ctx = STATIC_CAST(struct curskey_ctx*, calloc(1, sizeof(*ctx)));
+	if (! ctx)
+		return NULL;
+
+	ctx->key_return = '\n';
+	return ctx;
+}
+
+void curskey_ctx_free(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	if (ctx && ctx != &curskey_default_ctx) {
+		curskey_thread_stop_ctx(ctx);
+		free(ctx->pasted.buf);
+		free(ctx);
+	}
+}
+
+void curskey_ctx_set_return(struct curskey_ctx *ctx, int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	*curskey_return(ctx) = keycode;
+}
 
 struct curskey_key {
 	const char *keyname;
@@ -44,30 +255,30 @@ struct curskey_key {
 int KEY_RETURN = '\n';
 
 // Common keynames + names for non-printable/whitespace characters.
+#define CURSKEY_KEY(NAME, KEYCODE) { NAME, KEYCODE },
 static const struct curskey_key curskey_keynames[] = {
-	// Keep this sorted by `keyname`
-	{ "DELETE",    KEY_DC     },
-	{ "DOWN",      KEY_DOWN   },
-	{ "END",       KEY_END    },
-	{ "ESCAPE",    KEY_ESCAPE },
-	{ "HOME",      KEY_HOME   },
-	{ "INSERT",    KEY_IC     },
-	{ "LEFT",      KEY_LEFT   },
-	{ "PAGEDOWN",  KEY_NPAGE  },
-	{ "PAGEUP",    KEY_PPAGE  },
-	{ "RIGHT",     KEY_RIGHT  },
-	{ "SPACE",     KEY_SPACE  },
-	{ "TAB",       KEY_TAB    },
-	{ "UP",        KEY_UP     },
+	CURSKEY_KEYNAMES(CURSKEY_KEY)
+};
+
+// Names of the curses KEY_ constants, with "KEY_" stripped off.
+// This is what keyname() would return for these keys, but without
+// having to scan the whole KEY_MIN..KEY_MAX range at runtime.
+#define CURSES_KEYNAME(NAME) { #NAME, KEY_##NAME },
+static const struct curskey_key curses_keynames[] = {
+	CURSKEY_CURSES_KEYNAMES(CURSES_KEYNAME)
 };
 
-#define STARTSWITH_KEY(S) ( \
-	(UPPER(S[0]) == 'K') && \
-	(UPPER(S[1]) == 'E') && \
-	(UPPER(S[2]) == 'Y') && \
+#define STARTSWITH_KEY(S, N) ( \
+	((N) >= 4)              && \
+	(UPPER(S[0]) == 'K')    && \
+	(UPPER(S[1]) == 'E')    && \
+	(UPPER(S[2]) == 'Y')    && \
 	(S[3] == '_'))
 
-static int curskey_find(const struct curskey_key *table, int size, const char *name)
+#define STREQ_N(S, N, LITERAL) \
+	((N) == sizeof(LITERAL) - 1 && !memcmp(S, LITERAL, N))
+
+static int curskey_find(const struct curskey_key *table, int size, const char *name, size_t len)
 	CURSES_LIB_NOEXCEPT
 {
 	int start = 0;
@@ -77,7 +288,9 @@ static int curskey_find(const struct curskey_key *table, int size, const char *n
 
 	while (1) {
 		i = (start+end) / 2;
-		cmp = strcasecmp(name, table[i].keyname);
+		cmp = strncasecmp(name, table[i].keyname, len);
+		if (cmp == 0 && strlen(table[i].keyname) != len)
+			cmp = -1;
 
 		if (cmp == 0)
 			return table[i].keycode;
@@ -90,88 +303,113 @@ static int curskey_find(const struct curskey_key *table, int size, const char *n
 	}
 }
 
+// Names of the characters, indexed by character. Control characters
+// other than TAB and ESCAPE are named by curskey_get_keydef() as C-x.
+static const char *const curskey_char_names[128] = {
+	/* 0000 */ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	/* 0010 */ NULL, "TAB", NULL, NULL, NULL, NULL, NULL, NULL,
+	/* 0020 */ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	/* 0030 */ NULL, NULL, NULL, "ESCAPE", NULL, NULL, NULL, NULL,
+	/* 0040 */ "SPACE", "!", "\"", "#", "$", "%", "&", "'",
+	/* 0050 */ "(", ")", "*", "+", ",", "-", ".", "/",
+	/* 0060 */ "0", "1", "2", "3", "4", "5", "6", "7",
+	/* 0070 */ "8", "9", ":", ";", "<", "=", ">", "?",
+	/* 0100 */ "@", "A", "B", "C", "D", "E", "F", "G",
+	/* 0110 */ "H", "I", "J", "K", "L", "M", "N", "O",
+	/* 0120 */ "P", "Q", "R", "S", "T", "U", "V", "W",
+	/* 0130 */ "X", "Y", "Z", "[", "\\", "]", "^", "_",
+	/* 0140 */ "`", "a", "b", "c", "d", "e", "f", "g",
+	/* 0150 */ "h", "i", "j", "k", "l", "m", "n", "o",
+	/* 0160 */ "p", "q", "r", "s", "t", "u", "v", "w",
+	/* 0170 */ "x", "y", "z", "{", "|", "}", "~", "BACKSPACE"
+};
+
+// Names of the curses keys, indexed by keycode - 0400. Our own names take
+// precedence over those of curses_keynames ("DELETE" instead of "DC").
+static const char *const curskey_key_names[] = {
+	/* 0400 */ NULL, "BREAK", "DOWN", "UP", "LEFT", "RIGHT", "HOME", "BACKSPACE",
+	/* 0410 */ NULL, "F1", "F2", "F3", "F4", "F5", "F6", "F7",
+	/* 0420 */ "F8", "F9", "F10", "F11", "F12", "F13", "F14", "F15",
+	/* 0430 */ "F16", "F17", "F18", "F19", "F20", "F21", "F22", "F23",
+	/* 0440 */ "F24", "F25", "F26", "F27", "F28", "F29", "F30", "F31",
+	/* 0450 */ "F32", "F33", "F34", "F35", "F36", "F37", "F38", "F39",
+	/* 0460 */ "F40", "F41", "F42", "F43", "F44", "F45", "F46", "F47",
+	/* 0470 */ "F48", "F49", "F50", "F51", "F52", "F53", "F54", "F55",
+	/* 0500 */ "F56", "F57", "F58", "F59", "F60", "F61", "F62", "F63",
+	/* 0510 */ "DL", "IL", "DELETE", "INSERT", "EIC", "CLEAR", "EOS", "EOL",
+	/* 0520 */ "SF", "SR", "PAGEDOWN", "PAGEUP", "STAB", "CTAB", "CATAB", "ENTER",
+	/* 0530 */ "SRESET", "RESET", "PRINT", "LL", "A1", "A3", "B2", "C1",
+	/* 0540 */ "C3", "BTAB", "BEG", "CANCEL", "CLOSE", "COMMAND", "COPY", "CREATE",
+	/* 0550 */ "END", "EXIT", "FIND", "HELP", "MARK", "MESSAGE", "MOVE", "NEXT",
+	/* 0560 */ "OPEN", "OPTIONS", "PREVIOUS", "REDO", "REFERENCE", "REFRESH", "REPLACE", "RESTART",
+	/* 0570 */ "RESUME", "SAVE", "SBEG", "SCANCEL", "SCOMMAND", "SCOPY", "SCREATE", "SDC",
+	/* 0600 */ "SDL", "SELECT", "SEND", "SEOL", "SEXIT", "SFIND", "SHELP", "SHOME",
+	/* 0610 */ "SIC", "SLEFT", "SMESSAGE", "SMOVE", "SNEXT", "SOPTIONS", "SPREVIOUS", "SPRINT",
+	/* 0620 */ "SREDO", "SREPLACE", "SRIGHT", "SRSUME", "SSAVE", "SSUSPEND", "SUNDO", "SUSPEND",
+	/* 0630 */ "UNDO", "MOUSE", "RESIZE"
+};
+
+// The table above follows the keycodes of ncurses and X/Open curses
+typedef char curskey_key_names_check[(KEY_BREAK == 0401 && KEY_F0 == 0410 && KEY_DL == 0510
+	&& KEY_BTAB == 0541 && KEY_SDL == 0600 && KEY_UNDO == 0630) ? 1 : -1];
+
+// Names of our own keys, indexed by keycode - KEY_PASTE
+static const char *const curskey_own_names[] = { "PASTE", "FOCUSIN", "FOCUSOUT" };
+
 /// Like the original keyname() function.
 /// Translates the value of a KEY_ constant to its name,
 /// but strips leading "KEY_" and parentheses ("KEY_F(...)") off.
-const char* curskey_keyname(int keycode)
+static const char* curskey_name(int keycode, int key_return)
 	CURSES_LIB_NOEXCEPT
 {
-	int i;
-	static char buf[8];
-	memset(buf, 0, sizeof(buf));
-
-	if (keycode > 32 && keycode < 127) {
-		buf[0] = keycode;
-		return buf;
-	}
-
-	if (keycode >= KEY_F(1) && keycode <= KEY_F(63)) {
-		i = keycode - KEY_F(0);
-		buf[0] = 'F';
-		if (i <= 9)
-			buf[1] = '0' + i;
-		else {
-			buf[1] = '0' + (i / 10);
-			buf[2] = '0' + (i % 10);
-		}
-		return buf;
-	}
-
-	if (keycode == KEY_RETURN)
+	if (keycode == key_return)
 		return "RETURN";
 
-	if (keycode == 127)
-		return "BACKSPACE";
-
-	for (i = 0; i < ARRAY_LEN(curskey_keynames); ++i)
-		if (keycode == curskey_keynames[i].keycode)
-			return curskey_keynames[i].keyname;
-
-	if (keycode >= KEY_MIN && keycode <= KEY_MAX) {
-		const char* s = keyname(keycode);
-		if (s && *s)
-			return STARTSWITH_KEY(s) ? s + 4: s;
-	}
-
+	if (keycode >= 0 && keycode < 128)
+		return curskey_char_names[keycode];
+	if (keycode >= 0400 && keycode < 0400 + ARRAY_LEN(curskey_key_names))
+		return curskey_key_names[keycode - 0400];
+	if (keycode >= KEY_PASTE && keycode < KEY_PASTE + ARRAY_LEN(curskey_own_names))
+		return curskey_own_names[keycode - KEY_PASTE];
 	return NULL;
 }
 
+const char* curskey_keyname(int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_name(keycode, KEY_RETURN);
+}
+
 /// Translate the name of a curses KEY_ constant to its value.
-static int curskey_keycode(const char *name)
+static int curskey_keycode(const char *name, size_t len, int key_return)
 	CURSES_LIB_NOEXCEPT
 {
 	int i;
 
-	if (STARTSWITH_KEY(name))
+	if (STARTSWITH_KEY(name, len)) {
 		name += 4;
+		len -= 4;
+	}
 
-	if (! strcasecmp(name, "RETURN"))
-		return KEY_RETURN;
+	if (len == 6 && ! strncasecmp(name, "RETURN", 6))
+		return key_return;
 
-	i = curskey_find(curskey_keynames, ARRAY_LEN(curskey_keynames), name);
+	i = curskey_find(curskey_keynames, ARRAY_LEN(curskey_keynames), name, len);
 	if (i != ERR)
 		return i;
 
-	if (UPPER(name[0]) == 'F') {
-		name += (name[1] == '(' ? 2 : 1);
+	if (len >= 2 && UPPER(name[0]) == 'F') {
+		const char *s = name + (name[1] == '(' ? 2 : 1);
+		const char *end = name + len;
+
+		for (i = 0; s < end && *s >= '0' && *s <= '9' && i <= 63; ++s)
+			i = i * 10 + (*s - '0');
 
-		i = strtoimax(name, NULL, 10);
 		if (i >= 1 && i <= 63)
 			return KEY_F(i);
 	}
 
-	for (i = KEY_MIN; i <= KEY_MAX; ++i)
-		if (i < KEY_F(1) || i > KEY_F(63)) {
-			const char* s = keyname(i);
-			if (s) {
-				if (STARTSWITH_KEY(s))
-					s += 4;
-				if (! strcasecmp(s, name))
-					return i;
-			}
-		}
-
-	return ERR;
+	return curskey_find(curses_keynames, ARRAY_LEN(curses_keynames), name, len);
 }
 
 #if 0
@@ -196,13 +434,19 @@ int curskey_mod_key(int key, unsigned int modifiers)
 }
 #endif
 
-int curskey_unmod_key(int key, unsigned int* modifiers)
+static int curskey_unmod(int key, unsigned int* modifiers, int key_return)
 	CURSES_LIB_NOEXCEPT
 {
 	unsigned int null_store;
 	if (!modifiers)
 		modifiers = &null_store;
 
+	if (key >= 0 && (key & CURSKEY_EXT)) {
+		*modifiers = (key >> CURSKEY_EXT_MOD_SHIFT) & CURSKEY_MOD_ALL;
+		key &= CURSKEY_EXT_KEY_MASK;
+		return (key >= CURSKEY_EXT_KEYS ? key - CURSKEY_EXT_KEYS : key);
+	}
+
 	*modifiers = key & (CURSKEY_MOD_SHIFT|CURSKEY_MOD_META|CURSKEY_MOD_CTRL);
 	key &= ~(CURSKEY_MOD_SHIFT|CURSKEY_MOD_META|CURSKEY_MOD_CTRL);
 
@@ -218,7 +462,7 @@ int curskey_unmod_key(int key, unsigned int* modifiers)
 	if (key < ' ' &&
 		key != KEY_ESCAPE && // We do not want C-I for TAB, etc...
 		key != KEY_TAB &&
-		key != KEY_RETURN) {
+		key != key_return) {
 		if (key == 0)
 			key = ' ';
 		else
@@ -234,96 +478,529 @@ int curskey_unmod_key(int key, unsigned int* modifiers)
 	return key;
 }
 
-const char *curskey_get_keydef(int keycode)
+int curskey_unmod_key(int key, unsigned int* modifiers)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_unmod(key, modifiers, KEY_RETURN);
+}
+
+static int curskey_ext(int key, unsigned int mod, int key_return)
+	CURSES_LIB_NOEXCEPT
+{
+	unsigned int key_mod;
+	int keycode;
+
+	if ((mod & ~CURSKEY_MOD_ALL) || (key = curskey_unmod(key, &key_mod, key_return)) == ERR)
+		return ERR;
+	mod |= key_mod;
+
+	// Prefer the legacy keycode if it does not lose any modifiers,
+	// Control drops Shift on letters (C-S-a is C-a)
+	keycode = curskey_mod_key(key, mod);
+	if (keycode != ERR && ! ((mod & CURSKEY_MOD_CTRL) && (mod & CURSKEY_MOD_SHIFT)
+			&& key >= 'a' && key <= 'z'))
+		return keycode;
+
+	if (key >= KEY_MIN && key <= KEY_MAX)
+		key += CURSKEY_EXT_KEYS;
+	else if (key > CURSKEY_META_RANGE)
+		return ERR;
+
+	return curskey_ext_char(key, mod);
+}
+
+int curskey_ext_key(int key, unsigned int mod)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_ext(key, mod, KEY_RETURN);
+}
+
+/// Store the UTF-8 encoding of `c` in `buf`, return its length
+static int curskey_utf8_encode(int c, char *buf)
+	CURSES_LIB_NOEXCEPT
+{
+	if (c < 0x80) {
+		buf[0] = STATIC_CAST(char, c);
+		return 1;
+	}
+	if (c < 0x800) {
+		buf[0] = STATIC_CAST(char, 0xC0 | (c >> 6));
+		buf[1] = STATIC_CAST(char, 0x80 | (c & 0x3F));
+		return 2;
+	}
+	if (c < 0x10000) {
+		buf[0] = STATIC_CAST(char, 0xE0 | (c >> 12));
+		buf[1] = STATIC_CAST(char, 0x80 | ((c >> 6) & 0x3F));
+		buf[2] = STATIC_CAST(char, 0x80 | (c & 0x3F));
+		return 3;
+	}
+	buf[0] = STATIC_CAST(char, 0xF0 | (c >> 18));
+	buf[1] = STATIC_CAST(char, 0x80 | ((c >> 12) & 0x3F));
+	buf[2] = STATIC_CAST(char, 0x80 | ((c >> 6) & 0x3F));
+	buf[3] = STATIC_CAST(char, 0x80 | (c & 0x3F));
+	return 4;
+}
+
+/// Decode the UTF-8 character at the start of `s` into `c`. Returns its
+/// length, 0 if `s` ends before the character does, -1 if it is invalid.
+static int curskey_utf8_decode(const unsigned char *s, size_t n, int *c)
+	CURSES_LIB_NOEXCEPT
+{
+	size_t len, i;
+
+	if (s[0] < 0x80) {
+		*c = s[0];
+		return 1;
+	}
+	else if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+		len = 2;
+		*c = s[0] & 0x1F;
+	}
+	else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+		len = 3;
+		*c = s[0] & 0x0F;
+	}
+	else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+		len = 4;
+		*c = s[0] & 0x07;
+	}
+	else
+		return -1;
+
+	for (i = 1; i < len; ++i) {
+		if (i >= n)
+			return 0;
+		if ((s[i] & 0xC0) != 0x80)
+			return -1;
+		*c = (*c << 6) | (s[i] & 0x3F);
+	}
+
+	// Overlong encodings, surrogates and characters above U+10FFFF
+	if ((len == 3 && *c < 0x800) || (len == 4 && (*c < 0x10000 || *c > 0x10FFFF))
+			|| (*c >= 0xD800 && *c <= 0xDFFF))
+		return -1;
+	return STATIC_CAST(int, len);
+}
+
+static int curskey_format_key(int keycode, char *buf, size_t size, int key_return)
 	CURSES_LIB_NOEXCEPT
 {
 	unsigned int mod;
-	static char buffer[128];
+	const char *name;
+	char utf8[5] = "";
+	size_t len;
+	char *s = buf;
+
+	if (curskey_is_mouse(keycode))
+		return ERR;
+
+	// Characters of extended keycodes may lie in the range of curses keys
+	if (keycode >= 0 && (keycode & CURSKEY_EXT)
+			&& (keycode & CURSKEY_EXT_KEY_MASK) > CURSKEY_META_RANGE
+			&& (keycode & CURSKEY_EXT_KEY_MASK) < CURSKEY_EXT_KEYS) {
+		curskey_unmod(keycode, &mod, key_return);
+		curskey_utf8_encode(keycode & CURSKEY_EXT_KEY_MASK, utf8);
+		name = utf8;
+	}
+	else {
+		const int ext = (keycode >= 0 && (keycode & CURSKEY_EXT));
+
+		keycode = curskey_unmod(keycode, &mod, key_return);
+
+		// Legacy keycodes cannot hold Shift on a letter, it is the case
+		// of the letter ("A", "C-A", not "S-a", "S-C-a")
+		if (! ext && (mod & CURSKEY_MOD_SHIFT) && keycode >= 'a' && keycode <= 'z') {
+			keycode = UPPER(keycode);
+			mod &= ~CURSKEY_MOD_SHIFT;
+		}
+
+		name = curskey_name(keycode, key_return);
+		if (! name)
+			return ERR;
+	}
 
-	keycode = curskey_unmod_key(keycode, &mod);
+	len = strlen(name);
+	if (mod & CURSKEY_MOD_SHIFT) len += 2;
+	if (mod & CURSKEY_MOD_CTRL)  len += 2;
+	if (mod & CURSKEY_MOD_META)  len += 2;
+	if (mod & CURSKEY_MOD_SUPER) len += 6;
+	if (mod & CURSKEY_MOD_HYPER) len += 6;
+	if (len >= size)
+		return ERR;
 
-	char *s = buffer;
 	if (mod & CURSKEY_MOD_SHIFT) { *s++ = 'S'; *s++ = '-'; }
 	if (mod & CURSKEY_MOD_CTRL)  { *s++ = 'C'; *s++ = '-'; }
 	if (mod & CURSKEY_MOD_META)  { *s++ = 'M'; *s++ = '-'; }
+	if (mod & CURSKEY_MOD_SUPER) { memcpy(s, "Super-", 6); s += 6; }
+	if (mod & CURSKEY_MOD_HYPER) { memcpy(s, "Hyper-", 6); s += 6; }
+	while ((*s++ = *name++));
 
-	const char* name = curskey_keyname(keycode);
-	if (name) {
-		strcpy(s, name);
-		return buffer;
-	}
+	return len;
+}
 
-	return NULL;
+int curskey_get_keydef_r(int keycode, char *buf, size_t size)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_format_key(keycode, buf, size, KEY_RETURN);
 }
 
-#define IS_CARET(S)   (S[0] == '^' && S[1] != '\0')
-#define IS_CONTROL(S) (UPPER(S[0]) == 'C' && S[1] == '-')
-#define IS_SHIFT(S)   (UPPER(S[0]) == 'S' && S[1] == '-')
-#define IS_META(S)   ((UPPER(S[0]) == 'M' || UPPER(S[0]) == 'A') && S[1] == '-')
+const char *curskey_get_keydef_ctx(struct curskey_ctx *ctx, int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	if (curskey_format_key(keycode, ctx->keydef, sizeof(ctx->keydef), *curskey_return(ctx)) == ERR)
+		return NULL;
+
+	return ctx->keydef;
+}
 
-int curskey_parse(const char *def)
+const char *curskey_get_keydef(int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_get_keydef_ctx(curskey_default(), keycode);
+}
+
+#define IS_CARET(S, N)   ((N) >= 2 && S[0] == '^')
+#define IS_CONTROL(S, N) ((N) >= 2 && UPPER(S[0]) == 'C' && S[1] == '-')
+#define IS_SHIFT(S, N)   ((N) >= 2 && UPPER(S[0]) == 'S' && S[1] == '-')
+#define IS_META(S, N)    ((N) >= 2 && (UPPER(S[0]) == 'M' || UPPER(S[0]) == 'A') && S[1] == '-')
+#define IS_SUPER(S, N)   ((N) >= 6 && ! strncasecmp(S, "Super-", 6))
+#define IS_HYPER(S, N)   ((N) >= 6 && ! strncasecmp(S, "Hyper-", 6))
+
+// Key names looked up during one curskey_parse_many() or
+// curskey_parse_lines() call. Keymaps use the same names with different
+// modifiers (C-LEFT, M-LEFT, S-LEFT), so each distinct name is searched
+// in the tables only once per batch.
+#define CURSKEY_NAME_CACHE_SIZE  64 // Power of two
+#define CURSKEY_NAME_CACHE_PROBE 4
+struct curskey_name_cache {
+	struct {
+		const char *name; // Points into the definitions, NULL if unused
+		size_t len;
+		int keycode;
+	} slot[CURSKEY_NAME_CACHE_SIZE];
+};
+
+/// curskey_keycode(), remembering the names found in `cache` if not NULL
+static int curskey_keycode_cached(struct curskey_name_cache *cache,
+	const char *name, size_t len, int key_return)
+	CURSES_LIB_NOEXCEPT
+{
+	unsigned int hash = 0;
+	size_t i;
+
+	if (! cache)
+		return curskey_keycode(name, len, key_return);
+
+	for (i = 0; i < len; ++i)
+		hash = hash * 31 + LOWER(STATIC_CAST(unsigned char, name[i]));
+
+	for (i = 0; i < CURSKEY_NAME_CACHE_PROBE; ++i) {
+		const size_t n = (hash + i) & (CURSKEY_NAME_CACHE_SIZE - 1);
+
+		if (! cache->slot[n].name) {
+			const int keycode = curskey_keycode(name, len, key_return);
+			if (keycode != ERR) {
+				cache->slot[n].name = name;
+				cache->slot[n].len = len;
+				cache->slot[n].keycode = keycode;
+			}
+			return keycode;
+		}
+		if (cache->slot[n].len == len && ! strncasecmp(cache->slot[n].name, name, len))
+			return cache->slot[n].keycode;
+	}
+
+	return curskey_keycode(name, len, key_return);
+}
+
+/// Parse a key definition, store the reason of failure in `error`.
+/// Names are looked up through `cache` if it is not NULL.
+static int curskey_parse_def(struct curskey_ctx *ctx, const char *def, size_t len,
+	struct curskey_name_cache *cache, int *error)
 	CURSES_LIB_NOEXCEPT
 {
 	int c;
 	unsigned int mod = 0;
 
 	for (;;) {
-		if (IS_CARET(def)) {
-			def += 1; mod |= CURSKEY_MOD_CTRL;
+		if (IS_CARET(def, len)) {
+			def += 1; len -= 1; mod |= CURSKEY_MOD_CTRL;
+		}
+		else if (IS_CONTROL(def, len)) {
+			def += 2; len -= 2; mod |= CURSKEY_MOD_CTRL;
 		}
-		else if (IS_CONTROL(def)) {
-			def += 2; mod |= CURSKEY_MOD_CTRL;
+		else if (IS_META(def, len)) {
+			def += 2; len -= 2; mod |= CURSKEY_MOD_META;
 		}
-		else if (IS_META(def)) {
-			def += 2; mod |= CURSKEY_MOD_META;
+		else if (IS_SHIFT(def, len)) {
+			def += 2; len -= 2; mod |= CURSKEY_MOD_SHIFT;
 		}
-		else if (IS_SHIFT(def)) {
-			def += 2; mod |= CURSKEY_MOD_SHIFT;
+		else if (IS_SUPER(def, len)) {
+			def += 6; len -= 6; mod |= CURSKEY_MOD_SUPER;
+		}
+		else if (IS_HYPER(def, len)) {
+			def += 6; len -= 6; mod |= CURSKEY_MOD_HYPER;
 		}
 		else
 			break;
 	}
 
-	if (*def == '\0')
+	if (len == 0) {
+		*error = CURSKEY_ERR_EMPTY;
 		return ERR;
-	else if (*(def+1) == '\0')
+	}
+	else if (len == 1)
 		c = *def;
+	// Key names are ASCII, only try UTF-8 for a non-ASCII lead byte
+	else if (STATIC_CAST(unsigned char, *def) >= 0x80
+			&& curskey_utf8_decode(REINTERPRET_CAST(const unsigned char*, def), len, &c)
+			== STATIC_CAST(int, len)) {
+		// Characters above 127 have no legacy keycode
+		*error = OK;
+		return curskey_ext_char(c, mod);
+	}
+	else if ((c = curskey_keycode_cached(cache, def, len, *curskey_return(ctx))) == ERR) {
+		*error = CURSKEY_ERR_KEYNAME;
+		return ERR;
+	}
+
+	if (ctx->options & CURSKEY_OPT_EXT_KEYS)
+		c = curskey_ext(c, mod, *curskey_return(ctx));
 	else
-		c = curskey_keycode(def);
+		c = curskey_mod_key(c, mod);
+
+	if (c == ERR) {
+		*error = CURSKEY_ERR_MODIFIER;
+		return ERR;
+	}
 
-	return curskey_mod_key(c, mod);
+	*error = OK;
+	return c;
 }
 
-int curskey_wgetch(WINDOW* win)
+int curskey_parse_n_ctx(struct curskey_ctx *ctx, const char *def, size_t len)
+	CURSES_LIB_NOEXCEPT
+{
+	int error;
+	return curskey_parse_def(ctx, def, len, NULL, &error);
+}
+
+int curskey_parse_n(const char *def, size_t len)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_parse_n_ctx(curskey_default(), def, len);
+}
+
+int curskey_parse_ctx(struct curskey_ctx *ctx, const char *def)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_parse_n_ctx(ctx, def, strlen(def));
+}
+
+int curskey_parse(const char *def)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_parse_n_ctx(curskey_default(), def, strlen(def));
+}
+
+int curskey_parse_many_ctx(struct curskey_ctx *ctx,
+	const char *const *defs, int count, int *keycodes, int *errors)
+	CURSES_LIB_NOEXCEPT
+{
+	struct curskey_name_cache cache;
+	int i;
+	int error;
+	int failed = 0;
+
+	memset(&cache, 0, sizeof(cache));
+	for (i = 0; i < count; ++i) {
+		keycodes[i] = curskey_parse_def(ctx, defs[i], strlen(defs[i]), &cache, &error);
+		failed += (error != OK);
+		if (errors)
+			errors[i] = error;
+	}
+
+	return failed;
+}
+
+int curskey_parse_many(const char *const *defs, int count, int *keycodes, int *errors)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_parse_many_ctx(curskey_default(), defs, count, keycodes, errors);
+}
+
+int curskey_parse_lines_ctx(struct curskey_ctx *ctx,
+	const char *buf, size_t len, int *keycodes, int *errors, int max)
+	CURSES_LIB_NOEXCEPT
+{
+	struct curskey_name_cache cache;
+	int i;
+	int error;
+	const char *end = buf + len;
+	const char *eol;
+	const char *next;
+
+	memset(&cache, 0, sizeof(cache));
+
+	for (i = 0; i < max && buf < end; ++i, buf = next) {
+		eol = STATIC_CAST(const char*, memchr(buf, '\n', end - buf));
+		next = (eol ? eol + 1 : end);
+		if (! eol)
+			eol = end;
+		if (eol > buf && eol[-1] == '\r')
+			--eol;
+
+		keycodes[i] = curskey_parse_def(ctx, buf, eol - buf, &cache, &error);
+		if (errors)
+			errors[i] = error;
+	}
+
+	return i;
+}
+
+int curskey_parse_lines(const char *buf, size_t len, int *keycodes, int *errors, int max)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_parse_lines_ctx(curskey_default(), buf, len, keycodes, errors, max);
+}
+
+/// wgetch() that first returns the keys of curskey_unread()
+static int curskey_wgetch_unread(struct curskey_ctx *ctx, WINDOW *win)
+	CURSES_LIB_NOEXCEPT
+{
+	return (ctx->unread.len ? ctx->unread.keys[--ctx->unread.len] : wgetch(win));
+}
+
+/// Give a key back to curskey_wgetch_unread()
+static void curskey_unread(struct curskey_ctx *ctx, int key)
+	CURSES_LIB_NOEXCEPT
+{
+	if (ctx->unread.len < STATIC_CAST(int, ARRAY_LEN(ctx->unread.keys)))
+		ctx->unread.keys[ctx->unread.len++] = key;
+}
+
+int curskey_wgetch_ctx(struct curskey_ctx *ctx, WINDOW* win)
 	CURSES_LIB_NOEXCEPT
 {
-	int ch = wgetch(win);
+	if (ctx->options & CURSKEY_OPT_DECODER) {
+		const int key = curskey_decoder_wgetch(ctx, win, FALSE);
+		CURSKEY_LATENCY_DONE(ctx);
+		return key;
+	}
+
+	int ch = curskey_wgetch_unread(ctx, win);
 	if (ch == KEY_ESCAPE) {
-		//nodelay(win, TRUE);
+		const int delay = curskey_wdelay(win);
 		wtimeout(win, 0);
-		int ch2 = wgetch(win);
-		wtimeout(win, -1);
-		//nodelay(win, FALSE);
+		int ch2 = curskey_wgetch_unread(ctx, win);
+		wtimeout(win, delay);
 		if (ch2 == ERR)
 			return KEY_ESCAPE;
-		else {
-			unsigned int mod;
-			ch2 = curskey_unmod_key(ch2, &mod);
-			return curskey_mod_key(ch2, mod|CURSKEY_MOD_META);
-		}
+		else
+			return curskey_meta_key(ch2, *curskey_return(ctx));
 	}
 
 	return ch;
 }
 
-int curskey_init()
+int curskey_wgetch(WINDOW* win)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_wgetch_ctx(curskey_default(), win);
+}
+
+/// Read a key or a whole character from curses, characters above 127
+/// as extended keycodes
+static int curskey_wget_char(struct curskey_ctx *ctx, WINDOW *win)
+	CURSES_LIB_NOEXCEPT
+{
+#if defined(NCURSES_WIDECHAR) && NCURSES_WIDECHAR
+	wint_t wc;
+
+	if (ctx->unread.len)
+		return ctx->unread.keys[--ctx->unread.len];
+	switch (wget_wch(win, &wc)) {
+	case ERR:          return ERR;
+	case KEY_CODE_YES: return STATIC_CAST(int, wc);
+	}
+	return (wc > CURSKEY_META_RANGE ? curskey_ext_char(STATIC_CAST(int, wc), 0) : STATIC_CAST(int, wc));
+#else
+	// Assemble the character from the bytes returned by wgetch()
+	unsigned char buf[4];
+	int ch = curskey_wgetch_unread(ctx, win), c, i, len;
+
+	if (ch < 0xC2 || ch > 0xF4)
+		return ch;
+
+	buf[0] = STATIC_CAST(unsigned char, ch);
+	len = (ch < 0xE0 ? 2 : ch < 0xF0 ? 3 : 4);
+
+	const int delay = curskey_wdelay(win);
+	wtimeout(win, curskey_escdelay_ctx(ctx));
+	for (i = 1; i < len; ++i) {
+		const int b = curskey_wgetch_unread(ctx, win);
+		if (b < 0x80 || b > 0xBF) {
+			if (b != ERR)
+				curskey_unread(ctx, b);
+			break;
+		}
+		buf[i] = STATIC_CAST(unsigned char, b);
+	}
+	wtimeout(win, delay);
+
+	if (curskey_utf8_decode(buf, STATIC_CAST(size_t, i), &c) != len) {
+		// Not UTF-8, return the bytes one by one
+		while (--i > 0)
+			curskey_unread(ctx, buf[i]);
+		return ch;
+	}
+	return curskey_ext_char(c, 0);
+#endif
+}
+
+int curskey_wget_wch_ctx(struct curskey_ctx *ctx, WINDOW *win)
+	CURSES_LIB_NOEXCEPT
+{
+	int key;
+
+	if (ctx->options & CURSKEY_OPT_DECODER) {
+		key = curskey_decoder_wgetch(ctx, win, TRUE);
+		CURSKEY_LATENCY_DONE(ctx);
+		return key;
+	}
+
+	key = curskey_wget_char(ctx, win);
+	if (key == KEY_ESCAPE) {
+		const int delay = curskey_wdelay(win);
+		wtimeout(win, 0);
+		key = curskey_wget_char(ctx, win);
+		wtimeout(win, delay);
+		if (key == ERR)
+			return KEY_ESCAPE;
+		return curskey_meta_key(key, *curskey_return(ctx));
+	}
+
+	return key;
+}
+
+int curskey_wget_wch(WINDOW* win)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_wget_wch_ctx(curskey_default(), win);
+}
+
+int curskey_init_ctx(struct curskey_ctx *ctx, WINDOW *win)
 	CURSES_LIB_NOEXCEPT
 {
-	// It is important to call keypad(stdscr, TRUE) before we are defining
+	// It is important to call keypad(win, TRUE) before we are defining
 	// our own keys, because keypad() does also define keys and would
 	// overwrite our Shift/Control-F{1..12} definitions.
-	keypad(stdscr, TRUE);
+	keypad(win, TRUE);
 #ifdef NCURSES_VERSION
+	// The decoder handles the modified xterm and rxvt keys by itself
+	if (ctx->options & CURSKEY_OPT_DECODER)
+		return OK;
+
 	//define_key("\x57", KEY_BACKSPACE); // 127 TODO?
 	define_xterm_keys();
 	define_rxvt_arrow('A', KEY_UP);
@@ -347,35 +1024,64 @@ int curskey_init()
 	return OK;
 }
 
+int curskey_init()
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_init_ctx(curskey_default(), stdscr);
+}
+
 /* ============================================================================
  * Color functions ============================================================
  * ==========================================================================*/
 
-short curses_color_parse(const char* s)
+short curses_color_parse_n(const char* s, size_t len)
 	CURSES_LIB_NOEXCEPT
 {
-	if (!strcmp(s, "default"))  return -1;
-	if (!strcmp(s, "black"))    return COLOR_BLACK;
-	if (!strcmp(s, "red"))      return COLOR_RED;
-	if (!strcmp(s, "green"))    return COLOR_GREEN;
-	if (!strcmp(s, "yellow"))   return COLOR_YELLOW;
-	if (!strcmp(s, "blue"))     return COLOR_BLUE;
-	if (!strcmp(s, "magenta"))  return COLOR_MAGENTA;
-	if (!strcmp(s, "cyan"))     return COLOR_CYAN;
-	if (!strcmp(s, "white"))    return COLOR_WHITE;
+	if (STREQ_N(s, len, "default"))  return -1;
+	if (STREQ_N(s, len, "black"))    return COLOR_BLACK;
+	if (STREQ_N(s, len, "red"))      return COLOR_RED;
+	if (STREQ_N(s, len, "green"))    return COLOR_GREEN;
+	if (STREQ_N(s, len, "yellow"))   return COLOR_YELLOW;
+	if (STREQ_N(s, len, "blue"))     return COLOR_BLUE;
+	if (STREQ_N(s, len, "magenta"))  return COLOR_MAGENTA;
+	if (STREQ_N(s, len, "cyan"))     return COLOR_CYAN;
+	if (STREQ_N(s, len, "white"))    return COLOR_WHITE;
+
+	// Accept what strtoimax() accepts: leading white space and a sign
+	const char *end = s + len;
+	int negative;
+	int i = 0;
+
+	while (s < end && isspace(STATIC_CAST(unsigned char, *s)))
+		++s;
+	negative = (s < end && *s == '-');
+	s += (s < end && (*s == '-' || *s == '+'));
+	if (s == end)
+		return COLOR_INVALID;
+
+	for (; s < end; ++s) {
+		if (*s < '0' || *s > '9')
+			return COLOR_INVALID;
+		i = i * 10 + (*s - '0');
+		if (i > 255)
+			return COLOR_INVALID;
+	}
 
-	char *end;
-	intmax_t i = strtoimax(s, &end, 10);
-	if (*s && !*end && i >= -1 && i <= 255)
-		return i;
+	if (negative)
+		return (i <= 1 ? -i : COLOR_INVALID);
 
-	return COLOR_INVALID;
+	return i;
 }
 
-const char* curses_color_tostring(short color)
+short curses_color_parse(const char* s)
+	CURSES_LIB_NOEXCEPT
+{
+	return curses_color_parse_n(s, strlen(s));
+}
+
+static const char* curses_color_name(short color)
 	CURSES_LIB_NOEXCEPT
 {
-	static char buf[8];
 	switch (color) {
 	case -1:            return "default";
 	case COLOR_BLACK:   return "black";
@@ -386,44 +1092,86 @@ const char* curses_color_tostring(short color)
 	case COLOR_MAGENTA: return "magenta";
 	case COLOR_CYAN:    return "cyan";
 	case COLOR_WHITE:   return "white";
-	default:
-		if (color >= 0)
-		{
-			buf[sizeof(buf)-1] = 0;
-			char* s = &buf[sizeof(buf)-1];
-			while (color) {
-				*--s = '0' + (color % 10);
-				color /= 10;
-			}
-			return s;
-		}
+	default:            return NULL;
 	}
+}
 
-	return NULL;
+int curses_color_tostring_r(short color, char *buf, size_t size)
+	CURSES_LIB_NOEXCEPT
+{
+	char digits[8];
+	char *d = &digits[sizeof(digits)];
+	const char *name = curses_color_name(color);
+	size_t len;
+
+	if (! name) {
+		if (color < 0)
+			return ERR;
+
+		*--d = 0;
+		do {
+			*--d = '0' + (color % 10);
+			color /= 10;
+		} while (color);
+		name = d;
+	}
+
+	len = strlen(name);
+	if (len >= size)
+		return ERR;
+
+	while ((*buf++ = *name++));
+	return len;
+}
+
+const char* curses_color_tostring_ctx(struct curskey_ctx *ctx, short color)
+	CURSES_LIB_NOEXCEPT
+{
+	const char *name = curses_color_name(color);
+
+	if (name)
+		return name;
+
+	if (curses_color_tostring_r(color, ctx->color, sizeof(ctx->color)) == ERR)
+		return NULL;
+
+	return ctx->color;
+}
+
+const char* curses_color_tostring(short color)
+	CURSES_LIB_NOEXCEPT
+{
+	return curses_color_tostring_ctx(curskey_default(), color);
 }
 
 /* ============================================================================
  * Attribute functions ========================================================
  * ==========================================================================*/
 
-unsigned int curses_attr_parse(const char* s)
+unsigned int curses_attr_parse_n(const char* s, size_t len)
 	CURSES_LIB_NOEXCEPT
 {
-	if (!strcmp(s, "bold"))       return A_BOLD;
-	if (!strcmp(s, "dim"))        return A_DIM;
-	if (!strcmp(s, "blink"))      return A_BLINK;
-	if (!strcmp(s, "italic"))
+	if (STREQ_N(s, len, "bold"))       return A_BOLD;
+	if (STREQ_N(s, len, "dim"))        return A_DIM;
+	if (STREQ_N(s, len, "blink"))      return A_BLINK;
+	if (STREQ_N(s, len, "italic"))
 #ifdef A_ITALIC
 		return A_ITALIC;
 #else
 		return A_NORMAL;
 #endif
-	if (!strcmp(s, "standout"))   return A_STANDOUT;
-	if (!strcmp(s, "underline"))  return A_UNDERLINE;
-	if (!strcmp(s, "normal"))     return A_NORMAL;
+	if (STREQ_N(s, len, "standout"))   return A_STANDOUT;
+	if (STREQ_N(s, len, "underline"))  return A_UNDERLINE;
+	if (STREQ_N(s, len, "normal"))     return A_NORMAL;
 	return A_INVALID;
 }
 
+unsigned int curses_attr_parse(const char* s)
+	CURSES_LIB_NOEXCEPT
+{
+	return curses_attr_parse_n(s, strlen(s));
+}
+
 const char* curses_attr_tostring(unsigned int attribute)
 	CURSES_LIB_NOEXCEPT
 {
@@ -445,33 +1193,2258 @@ const char* curses_attr_tostring(unsigned int attribute)
  * Create pair functions ======================================================
  * ==========================================================================*/
 
-static int last_id = 0;
-static int color_pairs[CURSES_LIB_COLORS];
-
 #define FG_BG(FG, BG) \
 	(STATIC_CAST(unsigned short, FG) | STATIC_CAST(unsigned short, BG) << 16)
 
-int curses_create_color_pair(short fg, short bg)
+int curses_create_color_pair_ctx(struct curskey_ctx *ctx, short fg, short bg)
 	CURSES_LIB_NOEXCEPT
 {
 	int pair_id;
 	int pair = FG_BG(fg, bg);
-	for (pair_id = 1; pair_id <= last_id; ++pair_id)
-		if (color_pairs[pair_id] == pair)
+	for (pair_id = 1; pair_id <= ctx->last_id; ++pair_id)
+		if (ctx->color_pairs[pair_id] == pair)
 			return pair_id;
 
-	if (last_id == CURSES_LIB_COLORS)
+	if (ctx->last_id == CURSES_LIB_COLORS)
 		return ERR;
 
-	color_pairs[pair_id] = pair;
+	ctx->color_pairs[pair_id] = pair;
 	init_pair(pair_id, fg, bg);
-	return ++last_id;
+	return ++ctx->last_id;
+}
+
+int curses_create_color_pair(short fg, short bg)
+	CURSES_LIB_NOEXCEPT
+{
+	return curses_create_color_pair_ctx(curskey_default(), fg, bg);
+}
+
+void curses_reset_color_pairs_ctx(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	ctx->last_id = 0;
 }
 
 void curses_reset_color_pairs()
 	CURSES_LIB_NOEXCEPT
 {
-	last_id = 0;
+	curses_reset_color_pairs_ctx(curskey_default());
+}
+
+/* ============================================================================
+ * Keymap functions ===========================================================
+ * ==========================================================================*/
+
+void curskey_keymap_init(struct curskey_keymap *map)
+	CURSES_LIB_NOEXCEPT
+{
+	memset(map, 0, sizeof(*map));
+}
+
+void curskey_keymap_free(struct curskey_keymap *map)
+	CURSES_LIB_NOEXCEPT
+{
+	for (int i = 0; i < CURSKEY_KEYMAP_PAGES; ++i) {
+		free(map->pages[i]);
+		map->pages[i] = NULL;
+	}
+
+	free(map->ext);
+	map->ext = NULL;
+	map->ext_count = map->ext_size = 0;
+}
+
+static struct curskey_keymap_entry* curskey_keymap_slot(
+	struct curskey_keymap_entry *ext, int size, int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	unsigned int mask = size - 1;
+	unsigned int i = (STATIC_CAST(unsigned int, keycode) * 0x9E3779B1u) >> 7 & mask;
+
+	while (ext[i].keycode && ext[i].keycode != keycode)
+		i = (i + 1) & mask;
+
+	return &ext[i];
+}
+
+static int curskey_keymap_grow_ext(struct curskey_keymap *map)
+	CURSES_LIB_NOEXCEPT
+{
+	int size = map->ext_size ? map->ext_size * 2 : 16;
+	struct curskey_keymap_entry *ext = STATIC_CAST(struct curskey_keymap_entry*,
+		calloc(size, sizeof(*ext)));
+
+	if (! ext)
+		return ERR;
+
+	for (int i = 0; i < map->ext_size; ++i)
+		if (map->ext[i].keycode)
+			*curskey_keymap_slot(ext, size, map->ext[i].keycode) = map->ext[i];
+
+	free(map->ext);
+	map->ext = ext;
+	map->ext_size = size;
+	return OK;
+}
+
+// Unbinding leaves the slot in use with NULL, so that probing still works
+static int curskey_keymap_bind_ext(struct curskey_keymap *map, int keycode, void *data)
+	CURSES_LIB_NOEXCEPT
+{
+	struct curskey_keymap_entry *entry;
+
+	if (! map->ext_size) {
+		if (! data)
+			return OK;
+		if (curskey_keymap_grow_ext(map) == ERR)
+			return ERR;
+	}
+
+	entry = curskey_keymap_slot(map->ext, map->ext_size, keycode);
+	if (! entry->keycode) {
+		if (! data)
+			return OK;
+		// Keep the table at most half full
+		if (2 * (map->ext_count + 1) > map->ext_size) {
+			if (curskey_keymap_grow_ext(map) == ERR)
+				return ERR;
+			entry = curskey_keymap_slot(map->ext, map->ext_size, keycode);
+		}
+		entry->keycode = keycode;
+		++map->ext_count;
+	}
+
+	entry->data = data;
+	return OK;
+}
+
+void* curskey_keymap_get_ext(const struct curskey_keymap *map, int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	if (! map->ext_size || keycode <= CURSKEY_KEY_MAX)
+		return NULL;
+
+	return curskey_keymap_slot(map->ext, map->ext_size, keycode)->data;
+}
+
+int curskey_keymap_bind(struct curskey_keymap *map, int keycode, void *data)
+	CURSES_LIB_NOEXCEPT
+{
+	void ***page;
+
+	if (keycode < 0)
+		return ERR;
+	if (keycode > CURSKEY_KEY_MAX)
+		return curskey_keymap_bind_ext(map, keycode, data);
+
+	page = &map->pages[keycode / CURSKEY_KEYMAP_PAGE_SIZE];
+	if (! *page) {
+		if (! data)
+			return OK;
+		*page = STATIC_CAST(void**, calloc(CURSKEY_KEYMAP_PAGE_SIZE, sizeof(void*)));
+		if (! *page)
+			return ERR;
+	}
+
+	(*page)[keycode % CURSKEY_KEYMAP_PAGE_SIZE] = data;
+	return OK;
+}
+
+int curskey_keymap_bind_many(struct curskey_keymap *map,
+	const char *const *keydefs, void *const *data, int count)
+	CURSES_LIB_NOEXCEPT
+{
+	int failed = 0;
+
+	for (int i = 0; i < count; ++i)
+		failed += (curskey_keymap_bind(map, curskey_parse(keydefs[i]), data[i]) == ERR);
+
+	return failed;
+}
+
+/* ============================================================================
+ * Key sequence functions =====================================================
+ * ==========================================================================*/
+
+int curskey_parse_seq(const char *keyseq, int *keycodes, int max)
+	CURSES_LIB_NOEXCEPT
+{
+	int count = 0;
+	const char *end;
+
+	for (;;) {
+		while (*keyseq == ' ')
+			++keyseq;
+
+		if (! *keyseq)
+			return count;
+
+		if (count == max)
+			return ERR;
+
+		for (end = keyseq; *end && *end != ' '; ++end);
+
+		if ((keycodes[count++] = curskey_parse_n(keyseq, end - keyseq)) == ERR)
+			return ERR;
+
+		keyseq = end;
+	}
+}
+
+struct curskey_chord_state {
+	void *data;
+	int children;
+};
+
+// Transition of the trie, `state` is -1 for unused slots
+struct curskey_chord_edge {
+	int state;
+	int keycode;
+	int next;
+};
+
+struct curskey_chords {
+	struct curskey_chord_state *states;
+	int states_count;
+	int states_size;
+	struct curskey_chord_edge *edges; // Open addressing, size is a power of 2
+	int edges_count;
+	int edges_size;
+	int timeout;
+	int state;    // Current state, 0 is the root
+	long last;    // Time of the last key fed, in milliseconds
+};
+
+static long curskey_time_ms()
+	CURSES_LIB_NOEXCEPT
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static long curskey_time_us()
+	CURSES_LIB_NOEXCEPT
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+static unsigned int curskey_chords_hash(int state, int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	unsigned int h = STATIC_CAST(unsigned int, state) * 31u + STATIC_CAST(unsigned int, keycode);
+	h *= 0x9E3779B1u;
+	return h ^ (h >> 16);
+}
+
+static struct curskey_chord_edge* curskey_chords_slot(
+	struct curskey_chord_edge *edges, int size, int state, int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	unsigned int mask = size - 1;
+	unsigned int i = curskey_chords_hash(state, keycode) & mask;
+
+	while (edges[i].state != -1 && (edges[i].state != state || edges[i].keycode != keycode))
+		i = (i + 1) & mask;
+
+	return &edges[i];
+}
+
+static int curskey_chords_grow_edges(struct curskey_chords *chords)
+	CURSES_LIB_NOEXCEPT
+{
+	int size = chords->edges_size ? chords->edges_size * 2 : 64;
+	struct curskey_chord_edge *edges = STATIC_CAST(struct curskey_chord_edge*,
+		malloc(size * sizeof(*edges)));
+
+	if (! edges)
+		return ERR;
+
+	for (int i = 0; i < size; ++i)
+		edges[i].state = -1;
+
+	for (int i = 0; i < chords->edges_size; ++i)
+		if (chords->edges[i].state != -1)
+			*curskey_chords_slot(edges, size, chords->edges[i].state,
+				chords->edges[i].keycode) = chords->edges[i];
+
+	free(chords->edges);
+	chords->edges = edges;
+	chords->edges_size = size;
+	return OK;
+}
+
+static int curskey_chords_add_state(struct curskey_chords *chords)
+	CURSES_LIB_NOEXCEPT
+{
+	if (chords->states_count == chords->states_size) {
+		int size = chords->states_size ? chords->states_size * 2 : 16;
+		struct curskey_chord_state *states = STATIC_CAST(struct curskey_chord_state*,
+			realloc(chords->states, size * sizeof(*states)));
+		if (! states)
+			return ERR;
+		chords->states = states;
+		chords->states_size = size;
+	}
+
+	chords->states[chords->states_count].data = NULL;
+	chords->states[chords->states_count].children = 0;
+	return chords->states_count++;
+}
+
+struct curskey_chords* curskey_chords_new(int timeout)
+	CURSES_LIB_NOEXCEPT
+{
+	struct curskey_chords *chords = STATIC_CAST(struct curskey_chords*,
+		calloc(1, sizeof(*chords)));
+
+	if (! chords)
+		return NULL;
+
+	chords->timeout = timeout;
+	if (curskey_chords_add_state(chords) == ERR || curskey_chords_grow_edges(chords) == ERR) {
+		curskey_chords_free(chords);
+		return NULL;
+	}
+
+	return chords;
+}
+
+void curskey_chords_free(struct curskey_chords *chords)
+	CURSES_LIB_NOEXCEPT
+{
+	if (chords) {
+		free(chords->states);
+		free(chords->edges);
+		free(chords);
+	}
+}
+
+int curskey_chords_bind_keys(struct curskey_chords *chords,
+	const int *keycodes, int count, void *data)
+	CURSES_LIB_NOEXCEPT
+{
+	struct curskey_chord_edge *edge;
+	int state = 0;
+
+	if (count <= 0)
+		return ERR;
+
+	for (int i = 0; i < count; ++i)
+		if (keycodes[i] < 0)
+			return ERR;
+
+	for (int i = 0; i < count; ++i) {
+		if (2 * (chords->edges_count + 1) > chords->edges_size)
+			if (curskey_chords_grow_edges(chords) == ERR)
+				return ERR;
+
+		edge = curskey_chords_slot(chords->edges, chords->edges_size, state, keycodes[i]);
+		if (edge->state == -1) {
+			int next = curskey_chords_add_state(chords);
+			if (next == ERR)
+				return ERR;
+			edge->state = state;
+			edge->keycode = keycodes[i];
+			edge->next = next;
+			chords->edges_count++;
+			chords->states[state].children++;
+		}
+
+		state = edge->next;
+	}
+
+	chords->states[state].data = data;
+	chords->state = 0;
+	return OK;
+}
+
+int curskey_chords_bind(struct curskey_chords *chords, const char *keyseq, void *data)
+	CURSES_LIB_NOEXCEPT
+{
+	int keycodes[CURSKEY_CHORD_KEYS_MAX];
+	int count = curskey_parse_seq(keyseq, keycodes, ARRAY_LEN(keycodes));
+
+	if (count == ERR)
+		return ERR;
+
+	return curskey_chords_bind_keys(chords, keycodes, count, data);
+}
+
+int curskey_chords_feed(struct curskey_chords *chords, int keycode, void **data)
+	CURSES_LIB_NOEXCEPT
+{
+	struct curskey_chord_edge *edge;
+	struct curskey_chord_state *state;
+	void *dummy;
+	long now;
+
+	if (! data)
+		data = &dummy;
+
+	// Timed out, accept a pending sequence
+	if (keycode == ERR) {
+		*data = chords->states[chords->state].data;
+		chords->state = 0;
+		return (*data ? CURSKEY_CHORD_MATCH : CURSKEY_CHORD_NOMATCH);
+	}
+
+	now = curskey_time_ms();
+	edge = curskey_chords_slot(chords->edges, chords->edges_size, chords->state, keycode);
+
+	// The key does not continue the prefix, match it from the start. A bound
+	// prefix is reported first, the caller feeds the key again.
+	if (chords->state && (edge->state == -1
+			|| (chords->timeout >= 0 && now - chords->last > chords->timeout))) {
+		*data = chords->states[chords->state].data;
+		chords->state = 0;
+		if (*data)
+			return CURSKEY_CHORD_REPLAY;
+		edge = curskey_chords_slot(chords->edges, chords->edges_size, 0, keycode);
+	}
+
+	chords->state = 0;
+	if (edge->state == -1)
+		return CURSKEY_CHORD_NOMATCH;
+
+	state = &chords->states[edge->next];
+	*data = state->data;
+	if (state->children) {
+		chords->state = edge->next;
+		chords->last = now;
+		return CURSKEY_CHORD_PREFIX;
+	}
+
+	return (*data ? CURSKEY_CHORD_MATCH : CURSKEY_CHORD_NOMATCH);
+}
+
+int curskey_chords_timeout(const struct curskey_chords *chords)
+	CURSES_LIB_NOEXCEPT
+{
+	long remaining;
+
+	if (! chords->state || chords->timeout < 0)
+		return -1;
+
+	remaining = chords->timeout - (curskey_time_ms() - chords->last);
+	return (remaining > 0 ? remaining : 0);
+}
+
+void curskey_chords_reset(struct curskey_chords *chords)
+	CURSES_LIB_NOEXCEPT
+{
+	chords->state = 0;
+}
+
+/* ============================================================================
+ * Input decoder functions ====================================================
+ * ==========================================================================*/
+
+// Keys of curskey_decode(), which has no terminfo. These are the sequences
+// that curskey_decode_params() does not cover, by default DEL is BACKSPACE.
+static const struct curskey_seq curskey_builtin_seqs[] = {
+	// Keep this sorted
+	{ "\033OM",  3, KEY_ENTER }, // Keypad ENTER in application mode
+	{ "\033[[A", 4, KEY_F(1)  }, // Linux console
+	{ "\033[[B", 4, KEY_F(2)  },
+	{ "\033[[C", 4, KEY_F(3)  },
+	{ "\033[[D", 4, KEY_F(4)  },
+	{ "\033[[E", 4, KEY_F(5)  },
+};
+
+static const struct curskey_seqtab curskey_builtin_seqtab = {
+	curskey_builtin_seqs, ARRAY_LEN(curskey_builtin_seqs), NULL,
+	CURSKEY_OPT_DECODED & ~(CURSKEY_OPT_ADAPTIVE_ESCDELAY|CURSKEY_OPT_UTF8)
+};
+
+static int curskey_seq_compare(const unsigned char *a, int a_len, const unsigned char *b, int b_len)
+	CURSES_LIB_NOEXCEPT
+{
+	int cmp = memcmp(a, b, STATIC_CAST(size_t, a_len < b_len ? a_len : b_len));
+	return (cmp ? cmp : a_len - b_len);
+}
+
+static int curskey_seq_sort_compare(const void *a, const void *b)
+	CURSES_LIB_NOEXCEPT
+{
+	const struct curskey_seq *x = STATIC_CAST(const struct curskey_seq*, a);
+	const struct curskey_seq *y = STATIC_CAST(const struct curskey_seq*, b);
+	return curskey_seq_compare(x->seq, x->len, y->seq, y->len);
+}
+
+/// Return the keycode bound to the escape sequence `s` in `tab`, or **ERR**
+static int curskey_seq_find(const struct curskey_seqtab *tab, const unsigned char *s, int len)
+	CURSES_LIB_NOEXCEPT
+{
+	int lo = 0, hi = tab->count - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		int cmp = curskey_seq_compare(tab->seqs[mid].seq, tab->seqs[mid].len, s, len);
+		if (cmp == 0)
+			return tab->seqs[mid].keycode;
+		else if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return ERR;
+}
+
+/// Collect the escape sequences known to ncurses (terminfo and define_key())
+static void curskey_load_seqs(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	int i, count = 0;
+
+	for (i = 0; i < 256; ++i)
+		ctx->byte_keys[i] = i;
+
+#ifdef NCURSES_VERSION
+	for (int keycode = KEY_MIN; keycode <= CURSKEY_KEY_MAX; ++keycode) {
+		char *s;
+		for (i = 0; (s = keybound(keycode, i)); ++i) {
+			size_t len = strlen(s);
+			if (len == 1)
+				ctx->byte_keys[STATIC_CAST(unsigned char, *s)] = keycode;
+			else if (*s == KEY_ESCAPE && len <= CURSKEY_SEQ_MAX
+					&& count < CURSKEY_SEQS_MAX) {
+				struct curskey_seq *seq = &ctx->seqs[count++];
+				memcpy(seq->seq, s, len);
+				seq->len = STATIC_CAST(int, len);
+				seq->keycode = keycode;
+			}
+			free(s);
+		}
+	}
+#endif
+
+	qsort(ctx->seqs, STATIC_CAST(size_t, count),
+		sizeof(*ctx->seqs), curskey_seq_sort_compare);
+	ctx->seqtab.seqs = ctx->seqs;
+	ctx->seqtab.count = count;
+	ctx->seqtab.byte_keys = ctx->byte_keys;
+}
+
+/// Apply the meta modifier the same way curskey_wgetch() does for "ESC key"
+static int curskey_meta_key(int key, int key_return)
+	CURSES_LIB_NOEXCEPT
+{
+	unsigned int mod;
+
+	if (curskey_is_mouse(key))
+		return ERR;
+	// Extended keycodes take any modifier, such as M-ä or M-C-TAB
+	if (key >= 0 && (key & CURSKEY_EXT))
+		return key | (CURSKEY_MOD_META << CURSKEY_EXT_MOD_SHIFT);
+
+	key = curskey_unmod(key, &mod, key_return);
+	return curskey_mod_key(key, mod|CURSKEY_MOD_META);
+}
+
+/// Return the length of the CSI or SS3 sequence at `s`, 0 if incomplete
+static int curskey_seq_length(const unsigned char *s, int n)
+	CURSES_LIB_NOEXCEPT
+{
+	int i = 2;
+
+	if (s[1] == 'O') {
+		// SS3, optionally carrying a modifier: "ESC O 5 P"
+		while (i < n && s[i] >= '0' && s[i] <= '9')
+			++i;
+		return (i < n ? i + 1 : 0);
+	}
+
+	if (i < n && s[i] == '[')   // Linux console: "ESC [ [ A"
+		return (n >= 4 ? 4 : 0);
+	if (i < n && s[i] == 'M')   // X10 mouse: "ESC [ M" and three bytes
+		return (n >= 6 ? 6 : 0);
+
+	for (; i < n; ++i) {
+		if ((s[i] >= 0x40 && s[i] <= 0x7E) || s[i] == '$') // '$' ends rxvt keys
+			return i + 1;
+		if (s[i] < 0x20 || s[i] > 0x7E)  // Not part of a sequence, cut it here
+			return i;
+	}
+
+	return 0;
+}
+
+/// Translate the modifier parameter of a CSI sequence. The parameter is
+/// 1 + a bitmask of Shift (1), Alt (2), Control (4), Super (8), Hyper (16) and
+/// Meta (32), the lock keys (64, 128) are ignored. Returns **ERR** if invalid.
+static int curskey_csi_mod(int param)
+	CURSES_LIB_NOEXCEPT
+{
+	if (param < 1 || param > 256)
+		return ERR;
+
+	--param;
+	return ((param & 1)  ? CURSKEY_MOD_SHIFT : 0)
+		| ((param & 34) ? CURSKEY_MOD_META  : 0)
+		| ((param & 4)  ? CURSKEY_MOD_CTRL  : 0)
+		| ((param & 8)  ? CURSKEY_MOD_SUPER : 0)
+		| ((param & 16) ? CURSKEY_MOD_HYPER : 0);
+}
+
+/// Keys of "CSI codepoint u" for the functional keys of the kitty keyboard
+/// protocol, which lie in the Unicode private use area starting at 57376
+static const int curskey_kitty_keys[] = {
+	KEY_F(13), KEY_F(14), KEY_F(15), KEY_F(16), KEY_F(17), KEY_F(18), // 57376
+	KEY_F(19), KEY_F(20), KEY_F(21), KEY_F(22), KEY_F(23), KEY_F(24),
+	KEY_F(25), KEY_F(26), KEY_F(27), KEY_F(28), KEY_F(29), KEY_F(30),
+	KEY_F(31), KEY_F(32), KEY_F(33), KEY_F(34), KEY_F(35),
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9',                  // 57399 keypad
+	'.', '/', '*', '-', '+', KEY_ENTER, '=', ',',
+	KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN, KEY_PPAGE, KEY_NPAGE,
+	KEY_HOME, KEY_END, KEY_IC, KEY_DC, KEY_B2,                         // 57427
+};
+
+/// Return the keycode for a character reported with modifiers by
+/// "CSI codepoint ; modifiers u" or "CSI 27 ; modifiers ; codepoint ~"
+static int curskey_char_key(int c, int mod, int key_return)
+	CURSES_LIB_NOEXCEPT
+{
+	int key;
+
+	if (c == 13)
+		key = key_return;
+	else if (c == 127)
+		key = KEY_BACKSPACE;
+	else if (c >= 57376 && c < 57376 + ARRAY_LEN(curskey_kitty_keys))
+		key = curskey_kitty_keys[c - 57376];
+	else if (c >= 0 && c <= CURSKEY_META_RANGE)
+		key = c;
+	else if (c > CURSKEY_META_RANGE) // Any other character
+		return curskey_ext_char(c, mod);
+	else
+		return ERR;
+
+	return curskey_ext(key, mod, key_return);
+}
+
+/// Keys of "CSI n ~", indexed by n. 25..34 are shifted function keys of rxvt.
+static const int curskey_csi_numbers[] = {
+	0,         KEY_HOME,  KEY_IC,    KEY_DC,    KEY_END,   // 0..4
+	KEY_PPAGE, KEY_NPAGE, KEY_HOME,  KEY_END,   0,         // 5..9
+	0,         KEY_F(1),  KEY_F(2),  KEY_F(3),  KEY_F(4),  // 10..14
+	KEY_F(5),  0,         KEY_F(6),  KEY_F(7),  KEY_F(8),  // 15..19
+	KEY_F(9),  KEY_F(10), 0,         KEY_F(11), KEY_F(12), // 20..24
+	KEY_F(3)|CURSKEY_MOD_SHIFT, KEY_F(4)|CURSKEY_MOD_SHIFT, 0,       // 25..27
+	KEY_F(5)|CURSKEY_MOD_SHIFT, KEY_F(6)|CURSKEY_MOD_SHIFT, 0,       // 28..30
+	KEY_F(7)|CURSKEY_MOD_SHIFT, KEY_F(8)|CURSKEY_MOD_SHIFT,          // 31..32
+	KEY_F(9)|CURSKEY_MOD_SHIFT, KEY_F(10)|CURSKEY_MOD_SHIFT,         // 33..34
+};
+
+/// Keys of "CSI 1 ; m X" and "SS3 m X", indexed by X - 'A'
+static const int curskey_csi_letters[] = {
+	KEY_UP,   KEY_DOWN, KEY_RIGHT, KEY_LEFT, KEY_B2,   KEY_END,  // A..F
+	0,        KEY_HOME, 0,         0,        0,        0,        // G..L
+	0,        0,        0,         KEY_F(1), KEY_F(2), KEY_F(3), // M..R
+	KEY_F(4), 0,        0,         0,        0,        0,        // S..X
+	0,        KEY_BTAB,                                          // Y..Z
+};
+
+/**
+ * Decode the parameterized forms "CSI n ; m ~", "CSI 1 ; m X" and "SS3 m X",
+ * where m is the modifier parameter (see curskey_csi_mod()), xterm's
+ * modifyOtherKeys form "CSI 27 ; m ; codepoint ~" and
+ * the rxvt forms "CSI n $", "CSI n ^", "CSI n @", "CSI a" and "SS3 a".
+ *
+ * `s` is a complete sequence of `len` bytes. Returns the keycode or **ERR**.
+ */
+static int curskey_decode_params(const unsigned char *s, int len, int key_return,
+		unsigned int options)
+	CURSES_LIB_NOEXCEPT
+{
+	const int ss3 = (s[1] == 'O');
+	const int final = s[len - 1];
+	int params[3] = { -1, -1, -1 }; // -1 = parameter is missing
+	int p = 0, key;
+
+	for (int i = 2; i < len - 1; ++i) {
+		if (s[i] >= '0' && s[i] <= '9') {
+			params[p] = (params[p] < 0 ? 0 : params[p] * 10) + (s[i] - '0');
+			if (params[p] > 1000)
+				return ERR;
+		}
+		else if (s[i] == ';' && ! ss3 && p < 2)
+			++p;
+		else
+			return ERR;
+	}
+
+	// SS3 only carries the modifier: "ESC O 5 P"
+	if (ss3) {
+		params[1] = params[0];
+		params[0] = -1;
+	}
+
+	if (params[1] == -1)
+		params[1] = 1;
+
+	// xterm's modifyOtherKeys: "CSI 27 ; modifiers ; codepoint ~"
+	if (p == 2) {
+		if (final != '~' || params[0] != 27 || params[2] < 0
+				|| !(options & CURSKEY_OPT_MODIFY_OTHER_KEYS))
+			return ERR;
+		const int mod = curskey_csi_mod(params[1]);
+		return (mod == ERR ? ERR : curskey_char_key(params[2], mod, key_return));
+	}
+
+	// Focus reports: "CSI I" and "CSI O"
+	if (! ss3 && (final == 'I' || final == 'O') && params[0] == -1 && ! p)
+		return ((options & CURSKEY_OPT_FOCUS) ? (final == 'I' ? KEY_FOCUS_IN : KEY_FOCUS_OUT) : ERR);
+
+	if (final == '~' && params[0] == 200)
+		key = ((options & CURSKEY_OPT_PASTE) ? KEY_PASTE : ERR);
+	else switch (final) {
+	case '~':
+	case '$':
+	case '^':
+	case '@':
+		if (ss3 || params[0] < 0 || params[0] >= ARRAY_LEN(curskey_csi_numbers)
+				|| ! curskey_csi_numbers[params[0]])
+			return ERR;
+		key = curskey_csi_numbers[params[0]];
+		if (final == '$')      key |= CURSKEY_MOD_SHIFT;
+		else if (final == '^') key |= CURSKEY_MOD_CTRL;
+		else if (final == '@') key |= CURSKEY_MOD_CTRL|CURSKEY_MOD_SHIFT;
+		break;
+	case 'a': case 'b': case 'c': case 'd':
+		// rxvt: "CSI a" is Shift-Up, "SS3 a" is Control-Up
+		if (params[0] != -1 || p)
+			return ERR;
+		key = curskey_csi_letters[final - 'a'] | (ss3 ? CURSKEY_MOD_CTRL : CURSKEY_MOD_SHIFT);
+		break;
+	default:
+		if (final < 'A' || final > 'Z' || params[0] > 1 || ! curskey_csi_letters[final - 'A'])
+			return ERR;
+		key = curskey_csi_letters[final - 'A'];
+	}
+
+	if (key == KEY_PASTE)  // Begin of a bracketed paste
+		return (params[1] == 1 ? KEY_PASTE : ERR);
+
+	const int mod = curskey_csi_mod(params[1]);
+	return (mod == ERR ? ERR : curskey_ext(key, mod, key_return));
+}
+
+/**
+ * Decode "CSI codepoint ; modifiers u" of the kitty keyboard protocol.
+ * Sub-parameters (":shifted-key", ":event-type") and the text parameter
+ * are ignored.
+ *
+ * `s` is a complete sequence of `len` bytes. Returns the keycode or **ERR**.
+ */
+static int curskey_decode_csi_u(const unsigned char *s, int len, int key_return)
+	CURSES_LIB_NOEXCEPT
+{
+	int params[2] = { -1, -1 };
+	int p = 0, sub = 0;
+
+	for (int i = 2; i < len - 1 && p < 2; ++i) {
+		if (s[i] >= '0' && s[i] <= '9') {
+			if (! sub)
+				params[p] = (params[p] < 0 ? 0 : params[p] * 10) + (s[i] - '0');
+			if (params[p] > 0x10FFFF)
+				return ERR;
+		}
+		else if (s[i] == ':')
+			sub = 1;
+		else if (s[i] == ';')
+			++p, sub = 0;
+		else
+			return ERR;
+	}
+
+	const int mod = curskey_csi_mod(params[1] == -1 ? 1 : params[1]);
+	return (mod == ERR ? ERR : curskey_char_key(params[0], mod, key_return));
+}
+
+/// Read the size of an in-band resize report:
+/// "CSI 48 ; rows ; columns ; height ; width t", the sizes in pixels are optional.
+static int curskey_decode_resize(const unsigned char *s, int len, int *rows, int *cols)
+	CURSES_LIB_NOEXCEPT
+{
+	int params[5] = { 0, 0, 0, 0, 0 };
+	int p = 0;
+
+	if (s[len - 1] != 't')
+		return FALSE;
+
+	for (int i = 2; i < len - 1; ++i) {
+		if (s[i] >= '0' && s[i] <= '9') {
+			if ((params[p] = params[p] * 10 + (s[i] - '0')) > 100000)
+				return FALSE;
+		}
+		else if (s[i] == ';' && p < 4)
+			++p;
+		else
+			return FALSE;
+	}
+	if (params[0] != 48 || p < 2 || params[1] < 1 || params[2] < 1)
+		return FALSE;
+
+	*rows = params[1];
+	*cols = params[2];
+	return TRUE;
+}
+
+/// Decode an SGR mouse report: "CSI < button ; column ; row M" for presses
+/// and motion, "m" as final byte for releases. Positions are 1-based.
+static int curskey_decode_sgr_mouse(const unsigned char *s, int len)
+	CURSES_LIB_NOEXCEPT
+{
+	int params[3] = { 0, 0, 0 };
+	int p = 0, button, action;
+
+	for (int i = 3; i < len - 1; ++i) {
+		if (s[i] >= '0' && s[i] <= '9') {
+			if ((params[p] = params[p] * 10 + (s[i] - '0')) > 100000)
+				return ERR;
+		}
+		else if (s[i] == ';' && p < 2)
+			++p;
+		else
+			return ERR;
+	}
+	if (p != 2 || params[1] < 1 || params[2] < 1)
+		return ERR;
+
+	// Low bits: button 1-3 or none, 64 adds wheel buttons, 128 extra buttons.
+	// 4, 8 and 16 are Shift, Meta and Control, 32 marks motion.
+	button = params[0] & ~(4|8|16|32);
+	if (button < 64)
+		button = (button == 3 ? 0 : button + 1);
+	else if (button < 128)
+		button = button - 64 + 4;
+	else if (button < 132)
+		button = button - 128 + 8;
+	else
+		return ERR;
+
+	if (s[len - 1] == 'm')
+		action = CURSKEY_MOUSE_RELEASE;
+	else
+		action = (params[0] & 32 ? CURSKEY_MOUSE_MOTION : CURSKEY_MOUSE_PRESS);
+
+	if (--params[1] > CURSKEY_MOUSE_POS_MAX) params[1] = CURSKEY_MOUSE_POS_MAX;
+	if (--params[2] > CURSKEY_MOUSE_POS_MAX) params[2] = CURSKEY_MOUSE_POS_MAX;
+
+	return curskey_mouse(button, action, params[1], params[2], (params[0] & (4|8|16)) << 7);
+}
+
+/**
+ * Decode the key at the start of `s`, using the keys of `tab`.
+ * `key_return` is the keycode of the Enter key. `utf8` decodes UTF-8
+ * characters as with CURSKEY_OPT_UTF8.
+ *
+ * Returns the number of bytes consumed and stores the keycode in `key`,
+ * **ERR** for unknown sequences that were skipped. Returns 0 if more bytes
+ * are needed, unless `final` is set.
+ */
+static int curskey_decode_key(const struct curskey_seqtab *tab, int key_return, int utf8,
+		const unsigned char *s, int n, int final, int *key)
+	CURSES_LIB_NOEXCEPT
+{
+	int len;
+
+	if (n == 0)
+		return 0;
+
+	if ((utf8 || (tab->options & CURSKEY_OPT_UTF8)) && s[0] >= 0x80) {
+		int c;
+		len = curskey_utf8_decode(s, STATIC_CAST(size_t, n), &c);
+		if (len > 0) {
+			*key = curskey_ext_char(c, 0);
+			return len;
+		}
+		if (len == 0 && ! final)
+			return 0;
+		// Not UTF-8, take the byte as it is
+	}
+
+	if (s[0] != KEY_ESCAPE) {
+		if (tab->byte_keys)
+			*key = tab->byte_keys[s[0]];
+		else
+			*key = (s[0] == 127 ? KEY_BACKSPACE : s[0]);
+		// Carriage return is Enter, as wgetch() translates it in nl() mode
+		if (*key == '\r')
+			*key = key_return;
+		return 1;
+	}
+
+	if (n == 1) {
+		*key = KEY_ESCAPE;
+		return final;
+	}
+
+	if (s[1] == '[' || s[1] == 'O') {
+		len = curskey_seq_length(s, n);
+		if (len > 3 && s[2] == '<' && (s[len - 1] == 'M' || s[len - 1] == 'm')) {
+			*key = ((tab->options & CURSKEY_OPT_MOUSE) ? curskey_decode_sgr_mouse(s, len) : ERR);
+			return len;
+		}
+		if (len > 5 && s[len - 1] == 't' && s[2] == '4' && s[3] == '8') {
+			int rows, cols;
+			*key = ((tab->options & CURSKEY_OPT_RESIZE)
+				&& curskey_decode_resize(s, len, &rows, &cols) ? KEY_RESIZE : ERR);
+			return len;
+		}
+		if (len) {
+			*key = curskey_seq_find(tab, s, len);
+			if (*key == ERR && s[1] == '[' && s[len - 1] == 'u') {
+				if (tab->options & (CURSKEY_OPT_KITTY|CURSKEY_OPT_MODIFY_OTHER_KEYS))
+					*key = curskey_decode_csi_u(s, len, key_return);
+			}
+			else if (*key == ERR)
+				*key = curskey_decode_params(s, len, key_return, tab->options);
+			// Unknown CSI sequences are skipped, an unknown SS3 sequence
+			// is read as meta key ("ESC O" followed by another key)
+			if (*key != ERR || s[1] == '[')
+				return len;
+		}
+		else if (! final)
+			return 0;
+	}
+
+	len = curskey_decode_key(tab, key_return, utf8, s + 1, n - 1, final, key);
+	if (len && *key != ERR)
+		*key = curskey_meta_key(*key, key_return);
+	return (len ? len + 1 : 0);
+}
+
+int curskey_escdelay_ctx(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	if (ctx->options & CURSKEY_OPT_ADAPTIVE_ESCDELAY)
+		return (ctx->escwait.samples ? ctx->escwait.delay : CURSKEY_ESCDELAY_INITIAL);
+#ifdef NCURSES_VERSION
+	return get_escdelay();
+#else
+	return 1000;
+#endif
+}
+
+int curskey_escdelay()
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_escdelay_ctx(curskey_default());
+}
+
+/// Take a measured gap into account, the same way TCP estimates its
+/// retransmission timeout from round trip times
+static void curskey_escwait_sample(struct curskey_ctx *ctx, long gap)
+	CURSES_LIB_NOEXCEPT
+{
+	const int g = STATIC_CAST(int, gap < CURSKEY_ESCDELAY_MAX ? gap : CURSKEY_ESCDELAY_MAX);
+
+	if (! ctx->escwait.samples++) {
+		ctx->escwait.gap = g;
+		ctx->escwait.var = g / 2;
+	}
+	else {
+		ctx->escwait.var = (3 * ctx->escwait.var + abs(ctx->escwait.gap - g)) / 4;
+		ctx->escwait.gap = (7 * ctx->escwait.gap + g) / 8;
+	}
+
+	ctx->escwait.delay = CURSKEY_ESCDELAY_MIN + ctx->escwait.gap + 4 * ctx->escwait.var;
+	if (ctx->escwait.delay > CURSKEY_ESCDELAY_MAX)
+		ctx->escwait.delay = CURSKEY_ESCDELAY_MAX;
+}
+
+/// Measure the gap if the bytes that just arrived continue an escape
+/// sequence, or count a gap of zero if they hold a complete one, so the
+/// delay also shrinks on terminals that never split sequences. `pending`
+/// is the number of bytes that were waiting for them, `start` is when the
+/// wait began.
+static void curskey_escwait_update(struct curskey_ctx *ctx, int pending, long start)
+	CURSES_LIB_NOEXCEPT
+{
+	const unsigned char *s = ctx->input.buf + ctx->input.pos;
+	const long now = curskey_time_ms();
+	int key;
+
+	if (pending && (s[1] == '[' || s[1] == 'O'))
+		curskey_escwait_sample(ctx, now - start);
+	else if (! pending && ! ctx->escwait.timeout && ctx->input.len > 2
+			&& s[0] == KEY_ESCAPE && (s[1] == '[' || s[1] == 'O')) {
+		if (curskey_decode_key(&ctx->seqtab, *curskey_return(ctx), FALSE, s, ctx->input.len, FALSE, &key) > 2
+				&& key != ERR)
+			curskey_escwait_sample(ctx, 0);
+	}
+	else if (! pending && ctx->escwait.timeout && s[0] == '['
+			&& now - ctx->escwait.timeout < CURSKEY_ESCDELAY_MAX) {
+		// Did we take the ESC of a sequence for a lone ESCAPE?
+		unsigned char seq[CURSKEY_SEQ_MAX] = { KEY_ESCAPE };
+		int n = (ctx->input.len < CURSKEY_SEQ_MAX ? ctx->input.len : CURSKEY_SEQ_MAX - 1);
+
+		memcpy(seq + 1, s, STATIC_CAST(size_t, n));
+		if (curskey_decode_key(&ctx->seqtab, *curskey_return(ctx), FALSE, seq, n + 1, FALSE, &key) > 2 && key != ERR)
+			curskey_escwait_sample(ctx, now - ctx->escwait.timeout);
+	}
+
+	ctx->escwait.timeout = 0;
+}
+
+static int curskey_wdelay(WINDOW *win)
+	CURSES_LIB_NOEXCEPT
+{
+#ifdef NCURSES_EXT_FUNCS
+	return wgetdelay(win);
+#else
+	(void) win;
+	return -1;
+#endif
+}
+
+/// Move the pending bytes to the start of the read-ahead buffer
+static void curskey_input_compact(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	if (ctx->input.pos) {
+		memmove(ctx->input.buf, ctx->input.buf + ctx->input.pos,
+			STATIC_CAST(size_t, ctx->input.len));
+		ctx->input.pos = 0;
+	}
+}
+
+/// Wait up to `delay` milliseconds (-1 = forever) for input and buffer it.
+/// Returns the number of bytes read, 0 on timeout, **ERR** on failure.
+static int curskey_input_read(struct curskey_ctx *ctx, int delay)
+	CURSES_LIB_NOEXCEPT
+{
+	struct pollfd pfd;
+	ssize_t r;
+
+	curskey_input_compact(ctx);
+
+	if (ctx->input.len == CURSKEY_INPUT_BUFSIZE)
+		return 0;
+
+	if (delay >= 0) {
+		pfd.fd = ctx->input.fd;
+		pfd.events = POLLIN;
+		r = poll(&pfd, 1, delay);
+		if (r <= 0)
+			return STATIC_CAST(int, r);
+	}
+
+	r = read(ctx->input.fd, ctx->input.buf + ctx->input.len,
+		STATIC_CAST(size_t, CURSKEY_INPUT_BUFSIZE - ctx->input.len));
+	if (r <= 0)
+		return ERR;
+
+	curskey_record_bytes(ctx, ctx->input.buf + ctx->input.len, STATIC_CAST(size_t, r));
+	CURSKEY_LATENCY_ARRIVE(ctx);
+	ctx->input.len += STATIC_CAST(int, r);
+	return STATIC_CAST(int, r);
+}
+
+/// Check if the terminal size changed, resize curses if it did
+static int curskey_input_resized(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	struct winsize ws;
+
+	if (ioctl(ctx->input.fd, TIOCGWINSZ, &ws) == -1)
+		return FALSE;
+	if (ws.ws_row == ctx->input.rows && ws.ws_col == ctx->input.cols)
+		return FALSE;
+
+	ctx->input.rows = ws.ws_row;
+	ctx->input.cols = ws.ws_col;
+	resize_term(ws.ws_row, ws.ws_col);
+	return TRUE;
+}
+
+/// Take the size of an in-band resize report.
+/// Returns FALSE if the size did not change.
+static int curskey_input_size_report(struct curskey_ctx *ctx, const unsigned char *s, int n)
+	CURSES_LIB_NOEXCEPT
+{
+	int rows, cols;
+
+	if (! curskey_decode_resize(s, n, &rows, &cols))
+		return FALSE;
+	if (rows == ctx->input.rows && cols == ctx->input.cols)
+		return FALSE;
+
+	ctx->input.rows = rows;
+	ctx->input.cols = cols;
+	return TRUE;
+}
+
+int curskey_term_size_ctx(struct curskey_ctx *ctx, int *rows, int *cols)
+	CURSES_LIB_NOEXCEPT
+{
+	if (ctx->input.rows <= 0 || ctx->input.cols <= 0)
+		return ERR;
+
+	*rows = ctx->input.rows;
+	*cols = ctx->input.cols;
+	return OK;
+}
+
+int curskey_term_size(int *rows, int *cols)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_term_size_ctx(curskey_default(), rows, cols);
+}
+
+/// Start collecting a bracketed paste after "CSI 200 ~"
+static void curskey_paste_begin(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	ctx->pasted.len = ctx->pasted.scanned = 0;
+	ctx->pasted.active = TRUE;
+	ctx->pasted.since = curskey_time_ms();
+}
+
+/// End the paste with the text that arrived so far
+static void curskey_paste_end(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	ctx->pasted.buf[ctx->pasted.len] = '\0';
+	ctx->pasted.active = FALSE;
+}
+
+/// Move the pending input into the paste buffer and look for "CSI 201 ~".
+/// Returns TRUE once the paste is complete, FALSE if more input is needed,
+/// **ERR** if out of memory.
+static int curskey_paste_step(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	static const char end[] = "\033[201~";
+	const size_t end_len = sizeof(end) - 1;
+	const size_t pending = STATIC_CAST(size_t, ctx->input.len);
+
+	// Make room for the pending bytes and for one read() after them
+	if (ctx->pasted.size < ctx->pasted.len + pending + CURSKEY_INPUT_BUFSIZE) {
+		size_t size = (ctx->pasted.size ? ctx->pasted.size : CURSKEY_INPUT_BUFSIZE);
+		while (size < ctx->pasted.len + pending + CURSKEY_INPUT_BUFSIZE)
+			size *= 2;
+		char *buf = STATIC_CAST(char*, realloc(ctx->pasted.buf, size));
+		if (! buf) {
+			ctx->pasted.active = FALSE;
+			return ERR;
+		}
+		ctx->pasted.buf = buf;
+		ctx->pasted.size = size;
+	}
+
+	if (pending) {
+		memcpy(ctx->pasted.buf + ctx->pasted.len,
+			ctx->input.buf + ctx->input.pos, pending);
+		ctx->pasted.len += pending;
+		ctx->pasted.since = curskey_time_ms();
+		ctx->input.pos = ctx->input.len = 0;
+	}
+
+	for (size_t i = ctx->pasted.scanned; i + end_len <= ctx->pasted.len; ++i) {
+		if (ctx->pasted.buf[i] == KEY_ESCAPE
+				&& ! memcmp(ctx->pasted.buf + i, end, end_len)) {
+			// Hand the input after the paste back to the read-ahead buffer.
+			// It came with the last read, so it fits.
+			ctx->input.len = STATIC_CAST(int, ctx->pasted.len - i - end_len);
+			memcpy(ctx->input.buf, ctx->pasted.buf + i + end_len,
+				STATIC_CAST(size_t, ctx->input.len));
+			ctx->pasted.len = (i < CURSKEY_PASTE_MAX ? i : CURSKEY_PASTE_MAX);
+			curskey_paste_end(ctx);
+			return TRUE;
+		}
+		ctx->pasted.scanned = i + 1;
+	}
+
+	// Drop the text beyond the limit, but keep what may be the start of
+	// the end sequence
+	if (ctx->pasted.len >= CURSKEY_PASTE_MAX + end_len) {
+		memmove(ctx->pasted.buf + CURSKEY_PASTE_MAX,
+			ctx->pasted.buf + ctx->pasted.len - (end_len - 1), end_len - 1);
+		ctx->pasted.len = CURSKEY_PASTE_MAX + end_len - 1;
+		ctx->pasted.scanned = CURSKEY_PASTE_MAX;
+	}
+
+	return FALSE;
+}
+
+/// Collect the bracketed paste, waiting up to `delay` milliseconds (-1 =
+/// forever) for its end. Further input is read directly into the paste
+/// buffer, so every byte is copied at most once. Returns **ERR** if the
+/// paste is incomplete, the next call continues it.
+static int curskey_paste_collect(struct curskey_ctx *ctx, int delay)
+	CURSES_LIB_NOEXCEPT
+{
+	const long deadline = curskey_time_ms() + delay;
+	int r;
+
+	while (! (r = curskey_paste_step(ctx))) {
+		struct pollfd pfd = { ctx->input.fd, POLLIN, 0 };
+		const long now = curskey_time_ms();
+		long wait = ctx->pasted.since + CURSKEY_ESCDELAY_MAX - now;
+
+		// Read what is there, but do not wait beyond the delay
+		if (delay >= 0 && deadline < now + wait)
+			wait = deadline - now;
+
+		if (poll(&pfd, 1, STATIC_CAST(int, wait > 0 ? wait : 0)) > 0) {
+			// Read no more than the read-ahead buffer holds, the input after
+			// the end of the paste goes back there. Keep room for the NUL.
+			size_t room = ctx->pasted.size - ctx->pasted.len - 1;
+			if (room > CURSKEY_INPUT_BUFSIZE)
+				room = CURSKEY_INPUT_BUFSIZE;
+			const ssize_t n = read(ctx->input.fd, ctx->pasted.buf + ctx->pasted.len, room);
+			if (n <= 0) {
+				curskey_paste_end(ctx);
+				break;
+			}
+			curskey_record_bytes(ctx, ctx->pasted.buf + ctx->pasted.len, STATIC_CAST(size_t, n));
+			ctx->pasted.len += STATIC_CAST(size_t, n);
+			ctx->pasted.since = curskey_time_ms();
+		}
+		else if (ctx->pasted.since + CURSKEY_ESCDELAY_MAX <= curskey_time_ms()) {
+			// The end of the paste did not arrive in time, return what we have
+			curskey_paste_end(ctx);
+			break;
+		}
+		else if (delay >= 0 && deadline <= curskey_time_ms())
+			return ERR;
+	}
+
+	return (r == ERR ? ERR : KEY_PASTE);
+}
+
+const char* curskey_paste_ctx(struct curskey_ctx *ctx, size_t *len)
+	CURSES_LIB_NOEXCEPT
+{
+	if (len)
+		*len = ctx->pasted.len;
+	return (ctx->pasted.buf ? ctx->pasted.buf : "");
+}
+
+const char* curskey_paste(size_t *len)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_paste_ctx(curskey_default(), len);
+}
+
+/// Take the next key from the read-ahead buffer, skipping unknown sequences.
+/// `utf8` decodes UTF-8 characters, see curskey_decode_key().
+/// Returns FALSE if the buffer does not hold a complete key.
+static int curskey_input_next(struct curskey_ctx *ctx, int utf8, int final, int *key)
+	CURSES_LIB_NOEXCEPT
+{
+	int n;
+
+	while ((n = curskey_decode_key(&ctx->seqtab, *curskey_return(ctx), utf8,
+			ctx->input.buf + ctx->input.pos, ctx->input.len, final, key))) {
+		const unsigned char *s = ctx->input.buf + ctx->input.pos;
+		CURSKEY_LATENCY_TAKE(ctx, s, n);
+		ctx->input.pos += n;
+		ctx->input.len -= n;
+		// Resize reports that repeat the known size are dropped
+		if (*key == KEY_RESIZE && ! curskey_input_size_report(ctx, s, n))
+			continue;
+		if (*key != ERR)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/// Decode the next key from the read-ahead buffer without taking it.
+/// Returns FALSE if the buffer does not start with a complete, known key.
+static int curskey_input_peek(struct curskey_ctx *ctx, int *key)
+	CURSES_LIB_NOEXCEPT
+{
+	return (curskey_decode_key(&ctx->seqtab, *curskey_return(ctx), FALSE,
+		ctx->input.buf + ctx->input.pos, ctx->input.len, FALSE, key) && *key != ERR);
+}
+
+/// Replacement for wgetch() if CURSKEY_OPT_DECODER is enabled, `utf8`
+/// decodes UTF-8 characters for curskey_wget_wch()
+static int curskey_decoder_wgetch(struct curskey_ctx *ctx, WINDOW *win, int utf8)
+	CURSES_LIB_NOEXCEPT
+{
+	int key, r;
+
+	if (ctx->pasted.active)
+		return curskey_paste_collect(ctx, curskey_wdelay(win));
+
+	while (! curskey_input_next(ctx, utf8, FALSE, &key)) {
+		// wgetch() refreshes the window before waiting for input
+		if (! ctx->input.len && ! is_pad(win)
+#ifdef _HASMOVED
+			&& (is_wintouched(win) || (win->_flags & _HASMOVED)))
+#else
+			&& is_wintouched(win))
+#endif
+			wrefresh(win);
+
+		const int pending = ctx->input.len;
+		const long start = (pending ? curskey_time_ms() : 0);
+
+		r = curskey_input_read(ctx, pending ? curskey_escdelay_ctx(ctx) : curskey_wdelay(win));
+		if (r == ERR) {
+			if (errno == EINTR && curskey_input_resized(ctx))
+				return KEY_RESIZE;
+			return ERR;
+		}
+		if (r == 0) { // Timeout, take what is there
+			if (pending)
+				ctx->escwait.timeout = start;
+			return (curskey_input_next(ctx, utf8, TRUE, &key) ? key : ERR);
+		}
+		if (ctx->options & CURSKEY_OPT_ADAPTIVE_ESCDELAY)
+			curskey_escwait_update(ctx, pending, start);
+	}
+
+	if (key == KEY_PASTE) {
+		curskey_paste_begin(ctx);
+		return curskey_paste_collect(ctx, curskey_wdelay(win));
+	}
+	if (key == KEY_RESIZE && (LINES != ctx->input.rows || COLS != ctx->input.cols))
+		resize_term(ctx->input.rows, ctx->input.cols);
+	return key;
+}
+
+int curskey_wgetch_batch_ctx(struct curskey_ctx *ctx, WINDOW *win, int *keys, int max)
+	CURSES_LIB_NOEXCEPT
+{
+	int n = 0;
+
+	if (max <= 0)
+		return ERR;
+
+	if (! (ctx->options & CURSKEY_OPT_DECODER)) {
+		const int delay = curskey_wdelay(win);
+		while (n < max && (keys[n] = curskey_wgetch_ctx(ctx, win)) != ERR) {
+			++n;
+			wtimeout(win, 0);
+		}
+		wtimeout(win, delay);
+		return (n ? n : ERR);
+	}
+
+	keys[0] = curskey_decoder_wgetch(ctx, win, FALSE);
+	CURSKEY_LATENCY_DONE(ctx);
+	if (keys[0] == ERR)
+		return ERR;
+	if (keys[0] == KEY_PASTE)
+		return 1;
+
+	// Decode everything that is buffered or can be read without waiting.
+	// An incomplete sequence at the end stays in the buffer. A paste ends
+	// the batch, as there is only one paste buffer.
+	for (n = 1; n < max; ++n) {
+		while (! curskey_input_next(ctx, FALSE, FALSE, &keys[n]))
+			if (curskey_input_read(ctx, 0) <= 0)
+				return n;
+		if (keys[n] == KEY_PASTE) {
+			curskey_paste_begin(ctx);
+			const int r = curskey_paste_collect(ctx, 0);
+			CURSKEY_LATENCY_DONE(ctx);
+			return (r == ERR ? n : n + 1);
+		}
+		CURSKEY_LATENCY_DONE(ctx);
+	}
+
+	return n;
+}
+
+int curskey_wgetch_batch(WINDOW *win, int *keys, int max)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_wgetch_batch_ctx(curskey_default(), win, keys, max);
+}
+
+int curskey_wgetch_repeat_ctx(struct curskey_ctx *ctx, WINDOW *win, int *repeat)
+	CURSES_LIB_NOEXCEPT
+{
+	int key, next;
+
+	*repeat = 1;
+	if (! (ctx->options & CURSKEY_OPT_DECODER)) {
+		// Only the keys decoded by curses are merged. Anything from an ESC
+		// on is left to curskey_wgetch_ctx(), the bytes of a sequence or of
+		// a meta key are no repeats.
+		key = curskey_wgetch_unread(ctx, win);
+		if (key == KEY_ESCAPE) {
+			curskey_unread(ctx, key);
+			return curskey_wgetch_ctx(ctx, win);
+		}
+		if (key == ERR)
+			return key;
+
+		const int delay = curskey_wdelay(win);
+		wtimeout(win, 0);
+		while ((next = curskey_wgetch_unread(ctx, win)) == key)
+			++*repeat;
+		wtimeout(win, delay);
+		if (next != ERR)
+			curskey_unread(ctx, next);
+		return key;
+	}
+
+	key = curskey_wgetch_ctx(ctx, win);
+	if (key == ERR || key == KEY_PASTE)
+		return key;
+
+	// Take the same key as long as it is buffered or can be read without
+	// waiting. An incomplete sequence at the end stays in the buffer.
+	for (;;) {
+		if (! curskey_input_peek(ctx, &next)
+				&& (curskey_input_read(ctx, 0) <= 0 || ! curskey_input_peek(ctx, &next)))
+			break;
+		if (next != key)
+			break;
+		curskey_input_next(ctx, FALSE, FALSE, &next);
+		CURSKEY_LATENCY_DONE(ctx);
+		++*repeat;
+	}
+
+	return key;
+}
+
+int curskey_wgetch_repeat(WINDOW *win, int *repeat)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_wgetch_repeat_ctx(curskey_default(), win, repeat);
+}
+
+int curskey_input_fd_ctx(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	return ctx->input.fd;
+}
+
+int curskey_input_fd()
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_input_fd_ctx(curskey_default());
+}
+
+int curskey_set_input_fd_ctx(struct curskey_ctx *ctx, int fd)
+	CURSES_LIB_NOEXCEPT
+{
+	if (fd < 0)
+		return ERR;
+
+	ctx->input.fd = fd;
+	ctx->input.pos = ctx->input.len = ctx->input.waiting = 0;
+	return OK;
+}
+
+int curskey_set_input_fd(int fd)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_set_input_fd_ctx(curskey_default(), fd);
+}
+
+void curskey_set_output_ctx(struct curskey_ctx *ctx, FILE *output)
+	CURSES_LIB_NOEXCEPT
+{
+	ctx->output = output;
+}
+
+void curskey_set_output(FILE *output)
+	CURSES_LIB_NOEXCEPT
+{
+	curskey_set_output_ctx(curskey_default(), output);
+}
+
+int curskey_feed_ctx(struct curskey_ctx *ctx, const char *bytes, size_t len)
+	CURSES_LIB_NOEXCEPT
+{
+	const size_t room = STATIC_CAST(size_t, CURSKEY_INPUT_BUFSIZE - ctx->input.len);
+
+	if (len > room)
+		len = room;
+
+	curskey_input_compact(ctx);
+	CURSKEY_LATENCY_ARRIVE(ctx);
+	memcpy(ctx->input.buf + ctx->input.len, bytes, len);
+	ctx->input.len += STATIC_CAST(int, len);
+	curskey_record_bytes(ctx, bytes, len);
+	return STATIC_CAST(int, len);
+}
+
+int curskey_feed(const char *bytes, size_t len)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_feed_ctx(curskey_default(), bytes, len);
+}
+
+int curskey_fill_ctx(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	const int r = curskey_input_read(ctx, 0);
+	return (r == ERR && errno == EAGAIN ? 0 : r);
+}
+
+int curskey_fill()
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_fill_ctx(curskey_default());
+}
+
+int curskey_drain_ctx(struct curskey_ctx *ctx, int *keys, int max, int *timeout)
+	CURSES_LIB_NOEXCEPT
+{
+	const long now = curskey_time_ms();
+	int n = 0;
+
+	*timeout = -1;
+
+	// Bytes arrived for an incomplete sequence, after one timed out, or
+	// hold complete ones
+	if (ctx->input.len > ctx->input.waiting) {
+		if ((ctx->options & CURSKEY_OPT_ADAPTIVE_ESCDELAY) && ! ctx->pasted.active)
+			curskey_escwait_update(ctx, ctx->input.waiting, ctx->input.since);
+		ctx->input.waiting = 0;
+	}
+
+	while (n < max) {
+		if (ctx->pasted.active) {
+			const int r = curskey_paste_step(ctx);
+			if (r == ERR)
+				break;
+			if (! r) {
+				const long left = ctx->pasted.since + CURSKEY_ESCDELAY_MAX - now;
+				if (left > 0) {
+					*timeout = STATIC_CAST(int, left);
+					break;
+				}
+				curskey_paste_end(ctx);
+			}
+			keys[n++] = KEY_PASTE;
+			CURSKEY_LATENCY_DONE(ctx);
+			break; // There is only one paste buffer
+		}
+
+		if (curskey_input_next(ctx, FALSE, FALSE, &keys[n])) {
+			if (keys[n] == KEY_PASTE)
+				curskey_paste_begin(ctx);
+			else {
+				++n;
+				CURSKEY_LATENCY_DONE(ctx);
+			}
+			continue;
+		}
+
+		if (! ctx->input.len)
+			break;
+
+		// An incomplete escape sequence, wait for the rest until the deadline
+		if (! ctx->input.waiting) {
+			ctx->input.waiting = ctx->input.len;
+			ctx->input.since = now;
+		}
+
+		const long left = ctx->input.since + curskey_escdelay_ctx(ctx) - now;
+		if (left > 0) {
+			*timeout = STATIC_CAST(int, left);
+			break;
+		}
+
+		ctx->escwait.timeout = ctx->input.since;
+		ctx->input.waiting = 0;
+		if (curskey_input_next(ctx, FALSE, TRUE, &keys[n])) {
+			++n;
+			CURSKEY_LATENCY_DONE(ctx);
+		}
+	}
+
+	return n;
+}
+
+int curskey_drain(int *keys, int max, int *timeout)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_drain_ctx(curskey_default(), keys, max, timeout);
+}
+
+/* ============================================================================
+ * Recording functions ========================================================
+ * ==========================================================================*/
+
+/// Store `value` as LEB128 varint in `buf`, return its length
+static int curskey_varint_encode(unsigned long value, unsigned char *buf)
+	CURSES_LIB_NOEXCEPT
+{
+	int n = 0;
+
+	while (value >= 0x80) {
+		buf[n++] = STATIC_CAST(unsigned char, value | 0x80);
+		value >>= 7;
+	}
+	buf[n++] = STATIC_CAST(unsigned char, value);
+	return n;
+}
+
+static int curskey_write_all(int fd, const void *buf, size_t len)
+	CURSES_LIB_NOEXCEPT
+{
+	const char *s = STATIC_CAST(const char*, buf);
+
+	while (len) {
+		ssize_t r = write(fd, s, len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return ERR;
+		s += r;
+		len -= STATIC_CAST(size_t, r);
+	}
+
+	return OK;
+}
+
+/// Append bytes that entered the decoder to the recording
+static void curskey_record_bytes(struct curskey_ctx *ctx, const void *bytes, size_t len)
+	CURSES_LIB_NOEXCEPT
+{
+	unsigned char head[20];
+	long now;
+	int n;
+
+	if (! ctx->record.active || ! len)
+		return;
+
+	now = curskey_time_us();
+	n = curskey_varint_encode(STATIC_CAST(unsigned long, now - ctx->record.last), head);
+	n += curskey_varint_encode(len, head + n);
+	ctx->record.last = now;
+
+	// Stop recording if the file cannot be written
+	if (curskey_write_all(ctx->record.fd, head, STATIC_CAST(size_t, n)) == ERR
+			|| curskey_write_all(ctx->record.fd, bytes, len) == ERR)
+		ctx->record.active = FALSE;
+}
+
+int curskey_record_ctx(struct curskey_ctx *ctx, int fd)
+	CURSES_LIB_NOEXCEPT
+{
+	ctx->record.active = FALSE;
+	if (fd < 0)
+		return OK;
+
+	if (curskey_write_all(fd, CURSKEY_RECORD_MAGIC, sizeof(CURSKEY_RECORD_MAGIC) - 1) == ERR)
+		return ERR;
+
+	ctx->record.active = TRUE;
+	ctx->record.fd = fd;
+	ctx->record.last = curskey_time_us();
+	return OK;
+}
+
+int curskey_record(int fd)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_record_ctx(curskey_default(), fd);
+}
+
+/* ============================================================================
+ * Latency functions ==========================================================
+ * ==========================================================================*/
+
+#ifdef CURSKEY_LATENCY
+/// Bytes are about to be appended to the input buffer
+static void curskey_latency_arrive(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	const long now = curskey_time_us();
+
+	if (! ctx->input.len) {
+		ctx->latency.since = now;
+		ctx->latency.mark = 0;
+	}
+	else
+		ctx->latency.mark = ctx->input.len;
+	ctx->latency.newest = now;
+}
+
+/// The key of the `n` bytes at `s` is about to be returned
+static void curskey_latency_take(struct curskey_ctx *ctx, const unsigned char *s, int n)
+	CURSES_LIB_NOEXCEPT
+{
+	ctx->latency.taken = TRUE;
+	ctx->latency.arrival = (ctx->latency.mark > 0 ? ctx->latency.since : ctx->latency.newest);
+
+	if (s[0] != '\033')
+		ctx->latency.key_class = CURSKEY_LATENCY_PLAIN;
+	else if (n == 1)
+		ctx->latency.key_class = CURSKEY_LATENCY_ESC;
+	else if (n > 2 && (s[1] == '[' || s[1] == 'O'))
+		ctx->latency.key_class = CURSKEY_LATENCY_SEQ;
+	else
+		ctx->latency.key_class = CURSKEY_LATENCY_META;
+
+	// The rest of the pending bytes arrived with the newest chunk
+	if ((ctx->latency.mark -= n) <= 0) {
+		ctx->latency.mark = 0;
+		ctx->latency.since = ctx->latency.newest;
+	}
+}
+
+/// Bucket of a latency: exact below 8, then 8 buckets per power of two
+static int curskey_latency_bucket(unsigned long v)
+	CURSES_LIB_NOEXCEPT
+{
+	int k = 0, i;
+
+	if (v < 8)
+		return STATIC_CAST(int, v);
+
+	while (v >> (k + 1))
+		++k;
+	i = (k - 2) * 8 + STATIC_CAST(int, (v >> (k - 3)) & 7);
+	return (i < CURSKEY_LATENCY_BUCKETS ? i : CURSKEY_LATENCY_BUCKETS - 1);
+}
+
+/// Highest latency of bucket `i`
+static long curskey_latency_bucket_max(int i)
+	CURSES_LIB_NOEXCEPT
+{
+	if (i < 8)
+		return i;
+
+	const int k = i / 8 + 2;
+	return ((8L + i % 8 + 1) << (k - 3)) - 1;
+}
+
+/// The key taken last has been returned
+static void curskey_latency_done(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+	const int key_class = ctx->latency.key_class;
+	long latency;
+
+	if (! ctx->latency.taken)
+		return;
+
+	latency = curskey_time_us() - ctx->latency.arrival;
+	++ctx->latency.counts[key_class][curskey_latency_bucket(
+		STATIC_CAST(unsigned long, latency > 0 ? latency : 0))];
+	ctx->latency.taken = FALSE;
+}
+#endif
+
+int curskey_latency_ctx(struct curskey_ctx *ctx, int key_class, struct curskey_latency *stats)
+	CURSES_LIB_NOEXCEPT
+{
+#ifdef CURSKEY_LATENCY
+	static const double quantiles[] = { .5, .9, .99, .999 };
+	long *const values[] = { &stats->p50, &stats->p90, &stats->p99, &stats->p999 };
+	long counts[CURSKEY_LATENCY_BUCKETS] = { 0 };
+	double sum = 0;
+	long seen = 0;
+	int i, c, q = 0;
+
+	if (key_class < -1 || key_class >= CURSKEY_LATENCY_CLASSES)
+		return ERR;
+
+	for (c = 0; c < CURSKEY_LATENCY_CLASSES; ++c)
+		if (key_class == -1 || key_class == c)
+			for (i = 0; i < CURSKEY_LATENCY_BUCKETS; ++i)
+				counts[i] += ctx->latency.counts[c][i];
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < CURSKEY_LATENCY_BUCKETS; ++i) {
+		if (! counts[i])
+			continue;
+		const long low = (i ? curskey_latency_bucket_max(i - 1) + 1 : 0);
+		if (! stats->count)
+			stats->min = low;
+		stats->max = curskey_latency_bucket_max(i);
+		stats->count += counts[i];
+		sum += counts[i] * (low + stats->max) / 2.0;
+	}
+
+	for (i = 0; i < CURSKEY_LATENCY_BUCKETS && q < 4; ++i) {
+		seen += counts[i];
+		while (q < 4 && seen && seen >= quantiles[q] * stats->count)
+			*values[q++] = curskey_latency_bucket_max(i);
+	}
+
+	if (stats->count)
+		stats->mean = STATIC_CAST(long, sum / stats->count);
+	return OK;
+#else
+	(void) ctx;
+	(void) key_class;
+	(void) stats;
+	return ERR;
+#endif
+}
+
+int curskey_latency(int key_class, struct curskey_latency *stats)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_latency_ctx(curskey_default(), key_class, stats);
+}
+
+void curskey_latency_reset_ctx(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+#ifdef CURSKEY_LATENCY
+	memset(ctx->latency.counts, 0, sizeof(ctx->latency.counts));
+#else
+	(void) ctx;
+#endif
+}
+
+void curskey_latency_reset()
+	CURSES_LIB_NOEXCEPT
+{
+	curskey_latency_reset_ctx(curskey_default());
+}
+
+/* ============================================================================
+ * Input thread functions =====================================================
+ * ==========================================================================*/
+
+#ifdef CURSKEY_THREAD
+/// Append an event to the queue, there must be room for it
+static void curskey_thread_push(struct curskey_ctx *ctx, int key, char *paste, size_t paste_len)
+	CURSES_LIB_NOEXCEPT
+{
+	const unsigned int head = ctx->thread.head;
+	struct curskey_event *ev = &ctx->thread.events[head % CURSKEY_THREAD_QUEUE];
+
+	ev->key = key;
+	ev->time = curskey_time_us();
+	ev->paste = paste;
+	ev->paste_len = paste_len;
+	__atomic_store_n(&ctx->thread.head, head + 1, __ATOMIC_SEQ_CST);
+
+	// The consumer had taken everything, it may be waiting for the descriptor
+	if (__atomic_load_n(&ctx->thread.tail, __ATOMIC_SEQ_CST) == head)
+		if (write(ctx->thread.notify[1], "", 1) < 0) { /* Already readable */ }
+}
+
+static void* curskey_thread_main(void *arg)
+	CURSES_LIB_NOEXCEPT
+{
+	struct curskey_ctx *ctx = STATIC_CAST(struct curskey_ctx*, arg);
+	int keys[64], timeout = -1;
+
+	for (;;) {
+		const unsigned int room = CURSKEY_THREAD_QUEUE
+			- (ctx->thread.head - __atomic_load_n(&ctx->thread.tail, __ATOMIC_ACQUIRE));
+		struct pollfd pfd[2];
+		int n, i;
+
+		pfd[0].fd = ctx->thread.wake[0];
+		pfd[0].events = POLLIN;
+		pfd[1].fd = ctx->input.fd;
+		pfd[1].events = POLLIN;
+		pfd[0].revents = pfd[1].revents = 0;
+
+		// Leave the input in the terminal while the queue is full, until
+		// the consumer takes from it
+		if (poll(pfd, (room ? 2 : 1), (room ? timeout : -1)) < 0 && errno != EINTR)
+			break;
+		if (pfd[0].revents) {
+			char discard[64];
+			if (read(ctx->thread.wake[0], discard, sizeof(discard)) < 0) { /* Nothing to clear */ }
+			if (__atomic_load_n(&ctx->thread.stop, __ATOMIC_SEQ_CST))
+				break;
+		}
+		if (! room)
+			continue;
+
+		if (pfd[1].revents && curskey_fill_ctx(ctx) == ERR) {
+			curskey_thread_push(ctx, ERR, NULL, 0);
+			break;
+		}
+
+		const int max = STATIC_CAST(int, room < 64 ? room : 64);
+		n = curskey_drain_ctx(ctx, keys, max, &timeout);
+		for (i = 0; i < n; ++i) {
+			char *paste = NULL;
+			size_t len = 0;
+
+			if (keys[i] == KEY_PASTE && (paste = STATIC_CAST(char*, malloc(ctx->pasted.len + 1)))) {
+				len = ctx->pasted.len;
+				memcpy(paste, curskey_paste_ctx(ctx, NULL), len + 1);
+			}
+			curskey_thread_push(ctx, keys[i], paste, len);
+		}
+
+		// More keys may be decoded already
+		if (n == max)
+			timeout = 0;
+	}
+
+	return NULL;
+}
+#endif
+
+int curskey_thread_start_ctx(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+#ifdef CURSKEY_THREAD
+	if (ctx->thread.running)
+		return ERR;
+
+	if (pipe(ctx->thread.wake))
+		return ERR;
+	if (pipe(ctx->thread.notify)) {
+		close(ctx->thread.wake[0]);
+		close(ctx->thread.wake[1]);
+		return ERR;
+	}
+	fcntl(ctx->thread.wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(ctx->thread.wake[1], F_SETFL, O_NONBLOCK);
+	fcntl(ctx->thread.notify[0], F_SETFL, O_NONBLOCK);
+	fcntl(ctx->thread.notify[1], F_SETFL, O_NONBLOCK);
+	ctx->thread.head = ctx->thread.tail = 0;
+	ctx->thread.stop = FALSE;
+
+	if (pthread_create(&ctx->thread.thread, NULL, curskey_thread_main, ctx)) {
+		close(ctx->thread.wake[0]);
+		close(ctx->thread.wake[1]);
+		close(ctx->thread.notify[0]);
+		close(ctx->thread.notify[1]);
+		return ERR;
+	}
+
+	ctx->thread.running = TRUE;
+	return OK;
+#else
+	(void) ctx;
+	return ERR;
+#endif
+}
+
+int curskey_thread_start()
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_thread_start_ctx(curskey_default());
+}
+
+int curskey_thread_stop_ctx(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+#ifdef CURSKEY_THREAD
+	if (! ctx->thread.running)
+		return ERR;
+
+	__atomic_store_n(&ctx->thread.stop, TRUE, __ATOMIC_SEQ_CST);
+	if (write(ctx->thread.wake[1], "", 1) < 0) { /* Already readable */ }
+	pthread_join(ctx->thread.thread, NULL);
+	ctx->thread.running = FALSE;
+
+	// Free the pastes nobody took
+	for (; ctx->thread.tail != ctx->thread.head; ++ctx->thread.tail)
+		free(ctx->thread.events[ctx->thread.tail % CURSKEY_THREAD_QUEUE].paste);
+
+	close(ctx->thread.wake[0]);
+	close(ctx->thread.wake[1]);
+	close(ctx->thread.notify[0]);
+	close(ctx->thread.notify[1]);
+	return OK;
+#else
+	(void) ctx;
+	return ERR;
+#endif
+}
+
+int curskey_thread_stop()
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_thread_stop_ctx(curskey_default());
+}
+
+int curskey_thread_fd_ctx(struct curskey_ctx *ctx)
+	CURSES_LIB_NOEXCEPT
+{
+#ifdef CURSKEY_THREAD
+	return (ctx->thread.running ? ctx->thread.notify[0] : -1);
+#else
+	(void) ctx;
+	return -1;
+#endif
+}
+
+int curskey_thread_fd()
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_thread_fd_ctx(curskey_default());
+}
+
+int curskey_thread_drain_ctx(struct curskey_ctx *ctx, struct curskey_event *events, int max)
+	CURSES_LIB_NOEXCEPT
+{
+#ifdef CURSKEY_THREAD
+	unsigned int tail = ctx->thread.tail, head;
+	char discard[64];
+	int full, n = 0;
+
+	if (! ctx->thread.running)
+		return 0;
+
+	// Clear the notification before looking at the queue, so that no key
+	// queued afterwards goes unnoticed
+	if (read(ctx->thread.notify[0], discard, sizeof(discard)) < 0) { /* Nothing to clear */ }
+
+	head = __atomic_load_n(&ctx->thread.head, __ATOMIC_ACQUIRE);
+	full = (head - tail == CURSKEY_THREAD_QUEUE);
+	while (n < max && tail != head) {
+		do
+			events[n++] = ctx->thread.events[tail++ % CURSKEY_THREAD_QUEUE];
+		while (n < max && tail != head);
+
+		__atomic_store_n(&ctx->thread.tail, tail, __ATOMIC_SEQ_CST);
+		head = __atomic_load_n(&ctx->thread.head, __ATOMIC_SEQ_CST);
+	}
+
+	// The thread waits for room once the queue is full
+	if (full && n)
+		if (write(ctx->thread.wake[1], "", 1) < 0) { /* Already readable */ }
+
+	return n;
+#else
+	(void) ctx;
+	(void) events;
+	(void) max;
+	return 0;
+#endif
+}
+
+int curskey_thread_drain(struct curskey_event *events, int max)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_thread_drain_ctx(curskey_default(), events, max);
+}
+
+/* ============================================================================
+ * Headless decoder functions =================================================
+ * ==========================================================================*/
+
+/// End of a bracketed paste
+static const unsigned char curskey_paste_end_seq[] = "\033[201~";
+#define CURSKEY_PASTE_END_LEN (ARRAY_LEN(curskey_paste_end_seq) - 1)
+
+/// Decode the key at the start of `s` for curskey_decode(),
+/// see curskey_decode_key()
+static int curskey_decoder_next(struct curskey_decoder *state,
+		const unsigned char *s, int n, int final, int *key)
+	CURSES_LIB_NOEXCEPT
+{
+	int len;
+
+	// Pass the pasted bytes through until the end of the paste
+	if (state->paste) {
+		for (len = 0; len < n && len < CURSKEY_PASTE_END_LEN; ++len)
+			if (s[len] != curskey_paste_end_seq[len])
+				break;
+		if (len == CURSKEY_PASTE_END_LEN) {
+			state->paste = 0;
+			*key = KEY_PASTE;
+			return len;
+		}
+		if (len == n && ! final)
+			return 0;
+		*key = s[0];
+		return 1;
+	}
+
+	len = curskey_decode_key(&curskey_builtin_seqtab,
+		(state->key_return ? state->key_return : '\n'), FALSE, s, n, final, key);
+	if (len && *key == KEY_PASTE)
+		state->paste = 1;
+	return len;
+}
+
+void curskey_decoder_init(struct curskey_decoder *state, int key_return)
+	CURSES_LIB_NOEXCEPT
+{
+	memset(state, 0, sizeof(*state));
+	state->key_return = key_return;
+}
+
+int curskey_decode(const unsigned char *bytes, size_t n,
+		struct curskey_decoder *state, int *keys)
+	CURSES_LIB_NOEXCEPT
+{
+	const unsigned char *end = bytes + n;
+	int count = 0, len, key;
+
+	// Complete the pending sequence, one byte at a time
+	while (state->len) {
+		len = curskey_decoder_next(state, state->pending, state->len,
+			state->len == CURSKEY_DECODER_PENDING, &key);
+		if (len) {
+			if (key != ERR)
+				keys[count++] = key;
+			state->len -= len;
+			memmove(state->pending, state->pending + len, STATIC_CAST(size_t, state->len));
+		}
+		else if (bytes < end)
+			state->pending[state->len++] = *bytes++;
+		else
+			return count;
+	}
+
+	while (bytes < end) {
+		const int left = (end - bytes > INT_MAX ? INT_MAX : STATIC_CAST(int, end - bytes));
+
+		len = curskey_decoder_next(state, bytes, left, left > CURSKEY_DECODER_PENDING, &key);
+		if (! len) {
+			memcpy(state->pending, bytes, STATIC_CAST(size_t, left));
+			state->len = left;
+			break;
+		}
+
+		if (key != ERR)
+			keys[count++] = key;
+		bytes += len;
+	}
+
+	return count;
+}
+
+int curskey_decode_flush(struct curskey_decoder *state, int *keys)
+	CURSES_LIB_NOEXCEPT
+{
+	int count = 0, len, key;
+
+	while (state->len) {
+		len = curskey_decoder_next(state, state->pending, state->len, TRUE, &key);
+		if (key != ERR)
+			keys[count++] = key;
+		state->len -= len;
+		memmove(state->pending, state->pending + len, STATIC_CAST(size_t, state->len));
+	}
+
+	return count;
+}
+
+// The stream of curskey_putcap(), tputs() passes no context to its callback
+static FILE *curskey_putcap_file;
+
+static int curskey_putcap_char(int c)
+	CURSES_LIB_NOEXCEPT
+{
+	return putc(c, curskey_putcap_file);
+}
+
+/// Send a terminfo capability to the terminal of `ctx`, bypassing the
+/// curses output. `fallback` is sent if the terminal description lacks
+/// the capability.
+static void curskey_putcap(struct curskey_ctx *ctx, const char *capname, const char *fallback)
+	CURSES_LIB_NOEXCEPT
+{
+	const char *s = (capname ? tigetstr(capname) : NULL);
+	if (! s || s == REINTERPRET_CAST(char*, -1))
+		s = fallback;
+	if (s) {
+		curskey_putcap_file = (ctx->output ? ctx->output : stdout);
+		tputs(s, 1, curskey_putcap_char);
+		fflush(curskey_putcap_file);
+	}
+}
+
+int curskey_enable_ctx(struct curskey_ctx *ctx, unsigned int options)
+	CURSES_LIB_NOEXCEPT
+{
+	if (options & ~CURSKEY_OPT_ALL)
+		return ERR;
+
+	// These options are implemented by the decoder
+	if (options & CURSKEY_OPT_DECODED)
+		options |= CURSKEY_OPT_DECODER;
+
+	if ((options & CURSKEY_OPT_DECODER) && !(ctx->options & CURSKEY_OPT_DECODER)) {
+		curskey_load_seqs(ctx);
+		ctx->input.rows = LINES;
+		ctx->input.cols = COLS;
+		ctx->input.pos = ctx->input.len = ctx->input.waiting = 0;
+		curskey_putcap(ctx, "smkx", NULL);
+	}
+
+	if ((options & CURSKEY_OPT_PASTE) && !(ctx->options & CURSKEY_OPT_PASTE))
+		curskey_putcap(ctx, "BE", "\033[?2004h");
+
+	// Push "disambiguate escape codes" on the keyboard mode stack
+	if ((options & CURSKEY_OPT_KITTY) && !(ctx->options & CURSKEY_OPT_KITTY))
+		curskey_putcap(ctx, NULL, "\033[>1u");
+
+	if ((options & CURSKEY_OPT_MODIFY_OTHER_KEYS) && !(ctx->options & CURSKEY_OPT_MODIFY_OTHER_KEYS))
+		curskey_putcap(ctx, NULL, "\033[>4;2m");
+
+	// Report presses, releases and motion with a button held, in SGR format
+	if ((options & CURSKEY_OPT_MOUSE) && !(ctx->options & CURSKEY_OPT_MOUSE))
+		curskey_putcap(ctx, NULL, "\033[?1002h\033[?1006h");
+
+	if ((options & CURSKEY_OPT_FOCUS) && !(ctx->options & CURSKEY_OPT_FOCUS))
+		curskey_putcap(ctx, NULL, "\033[?1004h");
+
+	// The terminal answers with its current size
+	if ((options & CURSKEY_OPT_RESIZE) && !(ctx->options & CURSKEY_OPT_RESIZE))
+		curskey_putcap(ctx, NULL, "\033[?2048h");
+
+	ctx->options |= options;
+	ctx->seqtab.options = ctx->options;
+	return OK;
+}
+
+int curskey_enable(unsigned int options)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_enable_ctx(curskey_default(), options);
+}
+
+int curskey_disable_ctx(struct curskey_ctx *ctx, unsigned int options)
+	CURSES_LIB_NOEXCEPT
+{
+	if (options & ~CURSKEY_OPT_ALL)
+		return ERR;
+
+	if (options & CURSKEY_OPT_DECODER)
+		options |= CURSKEY_OPT_DECODED;
+
+	if (options & ctx->options & CURSKEY_OPT_KITTY)
+		curskey_putcap(ctx, NULL, "\033[<u");
+
+	if (options & ctx->options & CURSKEY_OPT_MODIFY_OTHER_KEYS)
+		curskey_putcap(ctx, NULL, "\033[>4m");
+
+	if (options & ctx->options & CURSKEY_OPT_MOUSE)
+		curskey_putcap(ctx, NULL, "\033[?1006l\033[?1002l");
+
+	if (options & ctx->options & CURSKEY_OPT_FOCUS)
+		curskey_putcap(ctx, NULL, "\033[?1004l");
+
+	if (options & ctx->options & CURSKEY_OPT_RESIZE)
+		curskey_putcap(ctx, NULL, "\033[?2048l");
+
+	if (options & ctx->options & CURSKEY_OPT_PASTE) {
+		curskey_putcap(ctx, "BD", "\033[?2004l");
+		free(ctx->pasted.buf);
+		ctx->pasted.buf = NULL;
+		ctx->pasted.len = ctx->pasted.size = 0;
+	}
+
+	if (options & ctx->options & CURSKEY_OPT_DECODER)
+		curskey_putcap(ctx, "rmkx", NULL);
+
+	ctx->options &= ~options;
+	ctx->seqtab.options = ctx->options;
+	return OK;
+}
+
+int curskey_disable(unsigned int options)
+	CURSES_LIB_NOEXCEPT
+{
+	return curskey_disable_ctx(curskey_default(), options);
 }
 
 /* ============================================================================
@@ -56,6 +56,20 @@
 #define CURSKEY_META_START 128
 /// Defines the range of characters which should be "meta-able"
 #define CURSKEY_META_RANGE 127
+/// Number of keycodes per page of a curskey_keymap
+#define CURSKEY_KEYMAP_PAGE_SIZE 64
+/// Size of the read-ahead buffer used by the input decoder
+#define CURSKEY_INPUT_BUFSIZE 4096
+/// Bounds and start value of the adaptive ESC delay in milliseconds
+#define CURSKEY_ESCDELAY_MIN      5
+#define CURSKEY_ESCDELAY_MAX      1000
+#define CURSKEY_ESCDELAY_INITIAL  50
+/// Most keys of a sequence passed to curskey_chords_bind()
+#define CURSKEY_CHORD_KEYS_MAX 32
+/// Longest text of a bracketed paste, the rest of the text is dropped
+#define CURSKEY_PASTE_MAX (1 << 20)
+/// Longest incomplete sequence kept by curskey_decode() between calls
+#define CURSKEY_DECODER_PENDING 32
 /// @}
 
 /// \defgroup CODES Return codes
@@ -64,6 +78,38 @@
 #define COLOR_INVALID -0xFF
 /// @}
 
+/// \defgroup PARSE_ERRORS Parse error codes
+/// Stored by curskey_parse_many() and curskey_parse_lines(),
+/// successfully parsed definitions get **OK**.
+/// @{
+#define CURSKEY_ERR_EMPTY     1 ///< The key definition is empty
+#define CURSKEY_ERR_KEYNAME   2 ///< The key name is unknown
+#define CURSKEY_ERR_MODIFIER  3 ///< The modifiers cannot be applied to the key
+/// @}
+
+/// \defgroup CHORD_RESULTS Key sequence matching results
+/// Returned by curskey_chords_feed()
+/// @{
+#define CURSKEY_CHORD_NOMATCH 0 ///< The keys typed so far are not bound
+#define CURSKEY_CHORD_PREFIX  1 ///< The keys typed so far start a bound sequence
+#define CURSKEY_CHORD_MATCH   2 ///< The keys typed so far form a bound sequence
+#define CURSKEY_CHORD_REPLAY  3 ///< The keys before the last one form a bound sequence
+/// @}
+
+/// \defgroup OPTIONS Options
+/// Passed to curskey_enable() and curskey_disable()
+/// @{
+#define CURSKEY_OPT_DECODER   (1 << 0) ///< Decode escape sequences in curskey_wgetch()
+#define CURSKEY_OPT_PASTE     (1 << 1) ///< Bracketed paste, implies CURSKEY_OPT_DECODER
+#define CURSKEY_OPT_KITTY     (1 << 2) ///< Kitty keyboard protocol, implies CURSKEY_OPT_DECODER
+#define CURSKEY_OPT_MODIFY_OTHER_KEYS (1 << 3) ///< xterm's modifyOtherKeys, implies CURSKEY_OPT_DECODER
+#define CURSKEY_OPT_ADAPTIVE_ESCDELAY (1 << 4) ///< Tune the ESC delay, implies CURSKEY_OPT_DECODER
+#define CURSKEY_OPT_MOUSE     (1 << 5) ///< SGR mouse reporting, implies CURSKEY_OPT_DECODER
+#define CURSKEY_OPT_FOCUS     (1 << 6) ///< Focus reporting, implies CURSKEY_OPT_DECODER
+#define CURSKEY_OPT_RESIZE    (1 << 7) ///< In-band resize reports, implies CURSKEY_OPT_DECODER
+#define CURSKEY_OPT_UTF8      (1 << 8) ///< Decode UTF-8 characters, implies CURSKEY_OPT_DECODER
+/// @}
+
 /// \defgroup KEYS Additional KEY_ constants
 /// @{
 #define KEY_SPACE      ' '
@@ -73,13 +119,107 @@
 #define KEY_DELETE     KEY_DC
 #define KEY_PAGEUP     KEY_PPAGE
 #define KEY_PAGEDOWN   KEY_NPAGE
+#define KEY_PASTE      0700 ///< Text was pasted, see curskey_paste()
+#define KEY_FOCUS_IN   0701 ///< The terminal gained the focus
+#define KEY_FOCUS_OUT  0702 ///< The terminal lost the focus
 /// @}
 
+/// Our key names and their keycodes as X(NAME, KEYCODE), sorted by name
+#define CURSKEY_KEYNAMES(X) \
+	X("DELETE",   KEY_DC) \
+	X("DOWN",     KEY_DOWN) \
+	X("END",      KEY_END) \
+	X("ESCAPE",   KEY_ESCAPE) \
+	X("FOCUSIN",  KEY_FOCUS_IN) \
+	X("FOCUSOUT", KEY_FOCUS_OUT) \
+	X("HOME",     KEY_HOME) \
+	X("INSERT",   KEY_IC) \
+	X("LEFT",     KEY_LEFT) \
+	X("PAGEDOWN", KEY_NPAGE) \
+	X("PAGEUP",   KEY_PPAGE) \
+	X("PASTE",    KEY_PASTE) \
+	X("RIGHT",    KEY_RIGHT) \
+	X("SPACE",    KEY_SPACE) \
+	X("TAB",      KEY_TAB) \
+	X("UP",       KEY_UP)
+
+/// Names of the curses KEY_ constants without "KEY_" as X(NAME), sorted
+#define CURSKEY_CURSES_KEYNAMES(X) \
+	X(A1) X(A3) X(B2) X(BACKSPACE) X(BEG) X(BREAK) X(BTAB) X(C1) X(C3) \
+	X(CANCEL) X(CATAB) X(CLEAR) X(CLOSE) X(COMMAND) X(COPY) X(CREATE) X(CTAB) \
+	X(DC) X(DL) X(DOWN) X(EIC) X(END) X(ENTER) X(EOL) X(EOS) X(EXIT) X(FIND) \
+	X(HELP) X(HOME) X(IC) X(IL) X(LEFT) X(LL) X(MARK) X(MESSAGE) \
+	CURSKEY_IF_KEY_MOUSE(X) X(MOVE) X(NEXT) X(NPAGE) X(OPEN) X(OPTIONS) \
+	X(PPAGE) X(PREVIOUS) X(PRINT) X(REDO) X(REFERENCE) X(REFRESH) X(REPLACE) \
+	X(RESET) CURSKEY_IF_KEY_RESIZE(X) X(RESTART) X(RESUME) X(RIGHT) X(SAVE) \
+	X(SBEG) X(SCANCEL) X(SCOMMAND) X(SCOPY) X(SCREATE) X(SDC) X(SDL) X(SELECT) \
+	X(SEND) X(SEOL) X(SEXIT) X(SF) X(SFIND) X(SHELP) X(SHOME) X(SIC) X(SLEFT) \
+	X(SMESSAGE) X(SMOVE) X(SNEXT) X(SOPTIONS) X(SPREVIOUS) X(SPRINT) X(SR) \
+	X(SREDO) X(SREPLACE) X(SRESET) X(SRIGHT) X(SRSUME) X(SSAVE) X(SSUSPEND) \
+	X(STAB) X(SUNDO) X(SUSPEND) X(UNDO) X(UP)
+
+#ifdef KEY_MOUSE
+#define CURSKEY_IF_KEY_MOUSE(X) X(MOUSE)
+#else
+#define CURSKEY_IF_KEY_MOUSE(X)
+#endif
+#ifdef KEY_RESIZE
+#define CURSKEY_IF_KEY_RESIZE(X) X(RESIZE)
+#else
+#define CURSKEY_IF_KEY_RESIZE(X)
+#endif
+
 /// \defgroup MODIFIER Modifiers
 /// @{
 #define CURSKEY_MOD_SHIFT   (1 << 9)
 #define CURSKEY_MOD_META    (1 << 10)
 #define CURSKEY_MOD_CTRL    (1 << 11)
+#define CURSKEY_MOD_SUPER   (1 << 12) ///< Only available in extended keycodes
+#define CURSKEY_MOD_HYPER   (1 << 13) ///< Only available in extended keycodes
+/// @}
+
+/// \defgroup EXT Extended keycodes
+/// Keys that have no legacy keycode, such as C-TAB or C-S-a, as reported
+/// by the kitty keyboard protocol or xterm's modifyOtherKeys. An extended keycode holds the modifiers
+/// shifted left by 12 bits and a Unicode character, or a curses key stored
+/// as CURSKEY_EXT_KEYS + KEY_...
+/// @{
+#define CURSKEY_EXT          (1 << 28) ///< Marks an extended keycode
+#define CURSKEY_EXT_KEYS     0x110000  ///< Offset of curses keys, above Unicode
+#define CURSKEY_EXT_KEY_MASK 0x1FFFFF  ///< Character or key of an extended keycode
+/// @}
+
+/// \defgroup MOUSE Mouse events
+/// Mouse events of **CURSKEY_OPT_MOUSE** are returned as keycodes holding
+/// the 0-based position (up to 1023), the button and the modifiers:
+///
+///     bits  0-9   column
+///     bits 10-19  row
+///     bits 20-23  button: 0 none (motion), 1 left, 2 middle, 3 right,
+///                 4/5 wheel up/down, 6/7 wheel left/right, 8-11 extra buttons
+///     bits 24-25  CURSKEY_MOUSE_PRESS, _RELEASE or _MOTION
+///     bits 26-27  Shift, Meta
+///     bit  29     Control
+///     bit  30     CURSKEY_MOUSE
+///
+/// Bit 28, the marker of extended keycodes, is never set.
+/// @{
+#define CURSKEY_MOUSE         (1 << 30) ///< Marks a mouse event
+#define CURSKEY_MOUSE_PRESS   0
+#define CURSKEY_MOUSE_RELEASE 1
+#define CURSKEY_MOUSE_MOTION  2
+#define CURSKEY_MOUSE_POS_MAX 1023
+
+#define curskey_is_mouse(KEY)     ((KEY) >= 0 && ((KEY) & CURSKEY_MOUSE))
+#define curskey_mouse_x(KEY)      ((KEY) & 0x3FF)
+#define curskey_mouse_y(KEY)      (((KEY) >> 10) & 0x3FF)
+#define curskey_mouse_button(KEY) (((KEY) >> 20) & 0xF)
+#define curskey_mouse_action(KEY) (((KEY) >> 24) & 0x3)
+/// Modifiers as **CURSKEY_MOD_SHIFT**, **CURSKEY_MOD_META** and **CURSKEY_MOD_CTRL**
+#define curskey_mouse_mods(KEY)   (((((KEY) >> 26) & 0x3) | (((KEY) >> 27) & 0x4)) << 9)
+#define curskey_mouse(BUTTON, ACTION, X, Y, MOD) (CURSKEY_MOUSE \
+	| (((MOD) >> 9 & 0x3) << 26) | (((MOD) >> 9 & 0x4) << 27) \
+	| ((ACTION) << 24) | ((BUTTON) << 20) | ((Y) << 10) | (X))
 /// @}
 
 /// Holds the character that should be interpreted as **RETURN**.
@@ -101,10 +241,115 @@ extern int KEY_RETURN;
 
 /**
  * @brief Initialize curskey.
+ *
+ * Defines the escape sequences of modified keys for xterm and rxvt.
+ * This is skipped if **CURSKEY_OPT_DECODER** has been enabled before,
+ * because the decoder reads these sequences by their parameters.
+ *
  * @return **OK** on success, **ERR** on failure
  */
 int curskey_init() CURSES_LIB_NOEXCEPT;
 
+/**
+ * @brief Enable options.
+ *
+ * With **CURSKEY_OPT_DECODER** curskey_wgetch() reads the terminal input
+ * into its own buffer and decodes escape sequences itself instead of
+ * relying on wgetch() and keypad(). Meta keys and bare **ESCAPE** are
+ * told apart from the buffered bytes, so the timeout of the window is
+ * left untouched. The sequences are taken from the terminfo entry and
+ * from define_key(). Modified keys in the xterm ("CSI n ; m ~") and rxvt
+ * ("CSI n $") forms are decoded from their parameters for any key number
+ * and all modifier combinations. Carriage return is returned as
+ * **KEY_RETURN**, like wgetch() does in nl() mode. The decoder neither
+ * reads keys pushed back with ungetch() nor echoes keys, regardless of
+ * echo().
+ *
+ * The reports of the options below are only decoded while the option is
+ * enabled, otherwise they are skipped like unknown sequences.
+ *
+ * With **CURSKEY_OPT_KITTY** the terminal is asked to disambiguate keys
+ * using the kitty keyboard protocol ("CSI > 1 u"). Keys that cannot be
+ * represented by a legacy keycode are returned as extended keycodes,
+ * and curskey_parse() accepts such combinations while it is enabled.
+ * Enable it before parsing the key bindings.
+ *
+ * **CURSKEY_OPT_MODIFY_OTHER_KEYS** does the same using xterm's
+ * modifyOtherKeys mode ("CSI > 4 ; 2 m"), which reports modified keys
+ * as "CSI 27 ; modifiers ; codepoint ~".
+ *
+ * With **CURSKEY_OPT_ADAPTIVE_ESCDELAY** the time to wait for the rest of
+ * an escape sequence is learned from the gaps observed inside of escape
+ * sequences, instead of using ESCDELAY. Sequences that arrive in one piece
+ * count as a gap of zero, so the delay shrinks on a local terminal. It starts
+ * at **CURSKEY_ESCDELAY_INITIAL** and stays within **CURSKEY_ESCDELAY_MIN**
+ * and **CURSKEY_ESCDELAY_MAX**, see curskey_escdelay().
+ *
+ * With **CURSKEY_OPT_PASTE** the terminal is put into bracketed paste
+ * mode. A paste is returned as a single **KEY_PASTE**, the pasted text
+ * is available through curskey_paste(). curskey_wgetch() waits for the
+ * rest of a paste no longer than the delay of the window; the next call
+ * continues the paste and returns **KEY_PASTE** once it is complete. Text
+ * beyond **CURSKEY_PASTE_MAX** bytes is dropped.
+ *
+ * With **CURSKEY_OPT_MOUSE** the terminal reports presses, releases and
+ * motion while a button is held ("CSI ? 1002 h") in the SGR format
+ * ("CSI ? 1006 h"). Each report is returned as a keycode of its own,
+ * see curskey_is_mouse(); this does not use getmouse() or **KEY_MOUSE**.
+ *
+ * With **CURSKEY_OPT_FOCUS** the terminal reports when it gains or loses
+ * the focus ("CSI ? 1004 h"), returned as **KEY_FOCUS_IN** and
+ * **KEY_FOCUS_OUT**.
+ *
+ * With **CURSKEY_OPT_RESIZE** the terminal reports its size in the input
+ * whenever it changes ("CSI ? 2048 h"). This is returned as **KEY_RESIZE**
+ * without waiting for SIGWINCH and asking the terminal for its size.
+ * curskey_wgetch() resizes curses; after curskey_drain(), take the size
+ * from curskey_term_size() and call resize_term().
+ *
+ * With **CURSKEY_OPT_UTF8** the decoder reads UTF-8 characters above 127
+ * as a whole and returns them as extended keycodes, curskey_ext_char(),
+ * with Meta if they follow ESC. Bytes that are not UTF-8 are returned as
+ * they are. curskey_wget_wch() always does this.
+ *
+ * @note  Call curskey_disable() before endwin()
+ *
+ * @param options  Bitwise OR of **CURSKEY_OPT_** constants
+ * @return **OK** on success, **ERR** on unknown options
+ */
+int curskey_enable(unsigned int options) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Disable options.
+ * @see curskey_enable()
+ *
+ * @param options  Bitwise OR of **CURSKEY_OPT_** constants
+ * @return **OK** on success, **ERR** on unknown options
+ */
+int curskey_disable(unsigned int options) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Return the terminal size last seen by the decoder
+ *
+ * This is updated by the reports of **CURSKEY_OPT_RESIZE** and when the
+ * decoder of curskey_wgetch() notices a resize after SIGWINCH.
+ *
+ * @param rows  Receives the number of lines
+ * @param cols  Receives the number of columns
+ *
+ * @return **OK** on success, **ERR** if the size is not known
+ */
+int curskey_term_size(int *rows, int *cols) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Return how long the decoder waits for the rest of an escape sequence.
+ *
+ * This is ESCDELAY, unless **CURSKEY_OPT_ADAPTIVE_ESCDELAY** is enabled.
+ *
+ * @return Delay in milliseconds
+ */
+int curskey_escdelay() CURSES_LIB_NOEXCEPT;
+
 /**
  * @brief Return the keycode for a key with modifiers applied.
  *
@@ -156,11 +401,32 @@ int curskey_init() CURSES_LIB_NOEXCEPT;
  * @brief The opposite of curskey_mod_key.
  *
  * Stores modifier mask in `modifiers` if it is not **NULL**.
+ * Extended keycodes are split up as well.
  *
  * @return The keycode with modifiers stripped of or **ERR** if the key is invalid.
  */
 int curskey_unmod_key(int key, unsigned int *modifiers) CURSES_LIB_NOEXCEPT;
 
+/**
+ * @brief Return the keycode for a key with any modifiers applied.
+ *
+ * Like curskey_mod_key(), but returns an extended keycode if there is
+ * no legacy keycode that keeps all modifiers (C-TAB, C-S-a, Super-UP).
+ * Characters above 127 need curskey_ext_char().
+ *
+ * @param key  Character up to 127 or curses KEY_ constant
+ * @param mod  Bitwise OR of **CURSKEY_MOD_** constants
+ *
+ * @return Keycode or **ERR** if the key is invalid.
+ */
+int curskey_ext_key(int key, unsigned int mod) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Return the extended keycode for a Unicode character with modifiers.
+ * @see curskey_ext_key()
+ */
+#define curskey_ext_char(CHAR, MOD) (CURSKEY_EXT | (signed) ((MOD) << 12) | (CHAR))
+
 /**
  * @brief Return the curses keycode for a key definition.
  *
@@ -170,6 +436,10 @@ int curskey_unmod_key(int key, unsigned int *modifiers) CURSES_LIB_NOEXCEPT;
  *	- Character with meta/alt-modifier (M-x, m-x, A-x, a-x, ...)
  *	- Character with both modifiers (C-M-x, M-C-x, M-^x, ...)
  *	- Curses keyname, no modifiers allowed (KEY_HOME, HOME, F1, F(1), ...)
+ *	- With **CURSKEY_OPT_KITTY** or **CURSKEY_OPT_MODIFY_OTHER_KEYS** enabled, any key with any of the modifiers
+ *	  C-, M-, S-, Super- and Hyper- (C-TAB, C-S-a, Super-UP, ...)
+ *	- A UTF-8 encoded character above 127 with any of the modifiers (ä, M-ä, C-é, ...),
+ *	  returned as extended keycode like curskey_wget_wch() does
  *
  * Returns **ERR** if either
  * 	- The key definition is NULL or empty
@@ -182,21 +452,68 @@ int curskey_unmod_key(int key, unsigned int *modifiers) CURSES_LIB_NOEXCEPT;
  */
 int curskey_parse(const char *keydef) CURSES_LIB_NOEXCEPT;
 
+/**
+ * @brief Like curskey_parse(), but takes the length of the key definition.
+ *
+ * The key definition does not have to be NUL-terminated.
+ */
+int curskey_parse_n(const char *keydef, size_t len) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Parse an array of key definitions.
+ *
+ * Stores the keycode of each definition in `keycodes` and, if `errors` is
+ * not **NULL**, its error code (see \ref PARSE_ERRORS) in `errors`.
+ * Each distinct key name is looked up only once per call, which makes
+ * this faster than calling curskey_parse() for every definition.
+ *
+ * @return The number of definitions that could not be parsed
+ */
+int curskey_parse_many(const char *const *keydefs, int count,
+	int *keycodes, int *errors) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Parse a buffer holding one key definition per line.
+ *
+ * Parses at most `max` lines. Keycodes and error codes are stored as in
+ * curskey_parse_many(). Lines may end in "\n" or "\r\n". The buffer does
+ * not have to be NUL-terminated.
+ *
+ * @return The number of lines parsed
+ */
+int curskey_parse_lines(const char *buf, size_t len,
+	int *keycodes, int *errors, int max) CURSES_LIB_NOEXCEPT;
+
 /**
  * @brief Return key definition for a curses keycode.
  *
  * The returned string is of the format "[C-][M-]KEY".
  *
- * @note This function is not thread-safe.
+ * @note This function is not thread-safe, see curskey_get_keydef_r().
  *
  * @return The key definition or **NULL** on error
  */
 const char* curskey_get_keydef(int keycode) CURSES_LIB_NOEXCEPT;
 
+/**
+ * @brief Reentrant version of curskey_get_keydef().
+ *
+ * Writes the key definition including the terminating NUL into `buf`.
+ *
+ * Only reads constant tables and **KEY_RETURN**, so it may be called from
+ * several threads at once without locking, also before curskey_init().
+ * The application must not change **KEY_RETURN** while other threads call it.
+ *
+ * @return Length of the key definition or **ERR** if the key is invalid
+ *         or `buf` is too small
+ */
+int curskey_get_keydef_r(int keycode, char *buf, size_t size) CURSES_LIB_NOEXCEPT;
+
 /**
  * @brief Replacement for wgetch
  *
- * @note  This changes the timeout of the window using **wtimeout()**
+ * @note  This changes the timeout of the window using **wtimeout()**,
+ *        unless **CURSKEY_OPT_DECODER** is enabled
  *
  * @return Keycode
  */
@@ -207,6 +524,635 @@ int curskey_wgetch(WINDOW*) CURSES_LIB_NOEXCEPT;
  */
 #define curskey_getch() curskey_wgetch(stdscr)
 
+/**
+ * @brief Replacement for wget_wch
+ *
+ * Like curskey_wgetch(), but reads a character above 127 in one call
+ * and returns it as extended keycode, curskey_ext_char(). Meta is
+ * attached to any character, so M-ä can be bound like M-a.
+ *
+ * With **CURSKEY_OPT_DECODER** the decoder reads UTF-8 as described for
+ * **CURSKEY_OPT_UTF8**. Otherwise wget_wch() is used if the curses library
+ * has wide character support (**NCURSES_WIDECHAR**), else the UTF-8 bytes
+ * returned by wgetch() are put together.
+ *
+ * @return Keycode
+ */
+int curskey_wget_wch(WINDOW*) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @see curskey_wget_wch()
+ */
+#define curskey_get_wch() curskey_wget_wch(stdscr)
+
+/**
+ * @brief Read all keys that are available at once
+ *
+ * Waits for the first key like curskey_wgetch(), then stores every key
+ * that is already buffered or can be read without waiting. This lets a
+ * paste or fast key repeat be handled with a single redraw.
+ *
+ * With **CURSKEY_OPT_DECODER** the keys are decoded from one read-ahead
+ * buffer, an incomplete escape sequence at the end is kept for the next
+ * call. Otherwise wgetch() is called until it has nothing left to return.
+ *
+ * @param keys  Receives the keycodes
+ * @param max   Size of `keys`
+ *
+ * @return Number of keys stored, **ERR** if no key was read
+ */
+int curskey_wgetch_batch(WINDOW*, int *keys, int max) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @see curskey_wgetch_batch()
+ */
+#define curskey_getch_batch(KEYS, MAX) curskey_wgetch_batch(stdscr, KEYS, MAX)
+
+/**
+ * @brief Read a key and merge the repeats of it that are buffered
+ *
+ * Waits for a key like curskey_wgetch(), then takes the same key as long
+ * as it follows immediately and is already buffered or can be read without
+ * waiting. A held arrow key on a slow link thus becomes a single key with
+ * a repeat count, handled with a single redraw.
+ *
+ * With **CURSKEY_OPT_DECODER** the keys are decoded from the read-ahead
+ * buffer. Otherwise only the keys decoded by curses are merged, wgetch()
+ * is called until it returns another key, which is kept for the next call.
+ * Meta keys and anything else that starts with an ESC are not merged then.
+ *
+ * **KEY_PASTE** and **KEY_ESCAPE** are not merged.
+ *
+ * @param repeat  Receives how often the key was pressed, at least 1
+ *
+ * @return Keycode
+ */
+int curskey_wgetch_repeat(WINDOW*, int *repeat) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @see curskey_wgetch_repeat()
+ */
+#define curskey_getch_repeat(REPEAT) curskey_wgetch_repeat(stdscr, REPEAT)
+
+/**
+ * @brief Return the text of the last **KEY_PASTE**
+ *
+ * The text is not copied, it stays valid until the next call of
+ * curskey_wgetch() or curskey_wgetch_batch().
+ *
+ * @param len  Receives the length of the text, may be NULL
+ *
+ * @return The NUL-terminated text, "" if nothing was pasted
+ */
+const char* curskey_paste(size_t *len) CURSES_LIB_NOEXCEPT;
+
+/* ============================================================================
+ * Non-blocking input functions ===============================================
+ * ==========================================================================*/
+
+/*
+ * These functions let an event loop drive the decoder of
+ * **CURSKEY_OPT_DECODER** without blocking:
+ *
+ *     poll() on curskey_input_fd(), using the timeout of curskey_drain()
+ *     curskey_fill() when the descriptor is readable (or curskey_feed())
+ *     curskey_drain() to take the decoded keys
+ */
+
+/**
+ * @brief Return the file descriptor the decoder reads from
+ *
+ * This is **STDIN_FILENO** unless changed by curskey_set_input_fd().
+ */
+int curskey_input_fd() CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Set the file descriptor the decoder reads from
+ *
+ * Input that was buffered from the previous descriptor is discarded.
+ *
+ * @return **OK** on success, **ERR** if `fd` is invalid
+ */
+int curskey_set_input_fd(int fd) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Set the stream that receives the terminal modes of the options
+ *
+ * curskey_enable() and curskey_disable() switch modes such as mouse
+ * reporting by writing to the terminal. Pass the output stream given to
+ * newterm(). **NULL**, the default, means stdout.
+ */
+void curskey_set_output(FILE *output) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Read the input that is available without blocking
+ *
+ * @return Number of bytes read, 0 if there was nothing to read
+ *         or the buffer is full, **ERR** on end of file or error
+ */
+int curskey_fill() CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Pass input bytes to the decoder
+ *
+ * Use this instead of curskey_fill() if the input is read elsewhere.
+ *
+ * @return Number of bytes taken, less than `len` if the buffer is full
+ */
+int curskey_feed(const char *bytes, size_t len) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Take the keys decoded from the buffered input
+ *
+ * Never blocks. If the buffered input ends with an incomplete escape
+ * sequence or bracketed paste, `timeout` receives the milliseconds
+ * until the decoder gives up waiting for the rest. Call curskey_drain()
+ * again when more input arrived or the timeout expired. Otherwise
+ * `timeout` receives -1.
+ *
+ * Like curskey_wgetch_batch(), at most one **KEY_PASTE** is returned.
+ *
+ * @param keys     Receives the keycodes
+ * @param max      Size of `keys`
+ * @param timeout  Receives the timeout in milliseconds or -1
+ *
+ * @return Number of keys stored
+ */
+int curskey_drain(int *keys, int max, int *timeout) CURSES_LIB_NOEXCEPT;
+
+/* ============================================================================
+ * Recording functions ========================================================
+ * ==========================================================================*/
+
+/// First bytes of a recording
+#define CURSKEY_RECORD_MAGIC "curskey\001"
+
+/**
+ * @brief Record the input of the decoder to `fd`
+ *
+ * Every chunk of bytes that the decoder of **CURSKEY_OPT_DECODER** reads
+ * or gets by curskey_feed() is written to `fd`, to be replayed by
+ * test/replay.c. The recording starts with **CURSKEY_RECORD_MAGIC**,
+ * followed by one record per chunk:
+ *
+ *     varint  Microseconds since the previous record (or the start)
+ *     varint  Number of bytes
+ *     bytes   The input
+ *
+ * Varints are unsigned LEB128: 7 bits per byte, least significant first,
+ * the high bit is set on all but the last byte. The clock is monotonic.
+ *
+ * Recording stops if a write fails.
+ *
+ * @param fd  Descriptor to write to, -1 to stop recording
+ *
+ * @return **OK** on success, **ERR** if the header could not be written
+ */
+int curskey_record(int fd) CURSES_LIB_NOEXCEPT;
+
+/* ============================================================================
+ * Latency functions ==========================================================
+ * ==========================================================================*/
+
+/// Key classes of curskey_latency()
+#define CURSKEY_LATENCY_PLAIN    0 ///< Bytes that are no escape sequence
+#define CURSKEY_LATENCY_META     1 ///< ESC followed by a key
+#define CURSKEY_LATENCY_SEQ      2 ///< CSI or SS3 sequence
+#define CURSKEY_LATENCY_ESC      3 ///< ESC on its own, after the ESC delay
+#define CURSKEY_LATENCY_CLASSES  4
+
+/// Buckets per class: exact below 8 microseconds, then 8 per power of two
+#define CURSKEY_LATENCY_BUCKETS  320
+
+/// Latencies in microseconds, each value is rounded up to its bucket
+struct curskey_latency {
+	long count;
+	long min;
+	long max;
+	long mean;
+	long p50;
+	long p90;
+	long p99;
+	long p999;
+};
+
+/**
+ * @brief Get the latency of the keys returned by the decoder
+ *
+ * Only available if curskey is compiled with **CURSKEY_LATENCY**, without
+ * it the instrumentation costs nothing.
+ *
+ * The decoder of **CURSKEY_OPT_DECODER** timestamps the arrival of the first
+ * byte of each key, read from the terminal or passed to curskey_feed(),
+ * and the latency is taken when the key is returned by curskey_wgetch(),
+ * curskey_wgetch_batch() or curskey_drain(). It includes the ESC delay,
+ * decoding and translation of the keycode.
+ *
+ * @param key_class  One of **CURSKEY_LATENCY_PLAIN**, **_META**, **_SEQ**,
+ *                   **_ESC**, or -1 for all
+ * @param stats      Receives the latencies
+ *
+ * @return **OK** on success, **ERR** if `key_class` is invalid or curskey is
+ *         compiled without **CURSKEY_LATENCY**
+ */
+int curskey_latency(int key_class, struct curskey_latency *stats) CURSES_LIB_NOEXCEPT;
+
+/// Clear the latencies of curskey_latency()
+void curskey_latency_reset() CURSES_LIB_NOEXCEPT;
+
+/* ============================================================================
+ * Input thread functions =====================================================
+ * ==========================================================================*/
+
+/// Capacity of the queue of curskey_thread_start(), a power of two
+#define CURSKEY_THREAD_QUEUE 1024
+
+/// Key decoded by the input thread
+struct curskey_event {
+	int key;           ///< Keycode, **ERR** if the input failed and the thread stopped
+	long time;         ///< When it was decoded, monotonic microseconds
+	char *paste;       ///< For **KEY_PASTE**: the NUL-terminated text, release it with free()
+	size_t paste_len;  ///< Length of `paste`
+};
+
+/*
+ * The input thread reads and decodes the input in the background, so that
+ * escape sequences are not split by the ESC delay while the application
+ * is busy. It pushes the keys into a lock-free queue of
+ * **CURSKEY_THREAD_QUEUE** events, which the application empties with
+ * curskey_thread_drain() without blocking:
+ *
+ *     poll() on curskey_thread_fd()
+ *     curskey_thread_drain() until it returns less than asked for
+ *
+ * Only available if curskey is compiled with **CURSKEY_THREAD** (and linked
+ * with -pthread), otherwise the functions fail.
+ */
+
+/**
+ * @brief Start the input thread
+ *
+ * The thread decodes like curskey_drain() what it reads from
+ * curskey_input_fd(). Until curskey_thread_stop(), nothing else may read
+ * the input, including curskey_wgetch() and wgetch(), or call functions
+ * of the context other than curskey_thread_drain() and curskey_thread_fd().
+ * Set up the terminal with curskey_init() and curskey_enable() first.
+ *
+ * If the queue is full, the input is left unread until there is room.
+ *
+ * @return **OK** on success, **ERR** if the thread is running already
+ *         or could not be created
+ */
+int curskey_thread_start() CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Stop the input thread
+ *
+ * Keys still in the queue are dropped.
+ *
+ * @return **OK** on success, **ERR** if the thread is not running
+ */
+int curskey_thread_stop() CURSES_LIB_NOEXCEPT;
+
+/// Descriptor that is readable when keys were queued, -1 if the thread is not running
+int curskey_thread_fd() CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Take the keys queued by the input thread
+ *
+ * Never blocks.
+ *
+ * @param events  Receives the keys
+ * @param max     Size of `events`
+ *
+ * @return Number of keys stored
+ */
+int curskey_thread_drain(struct curskey_event *events, int max) CURSES_LIB_NOEXCEPT;
+
+/* ============================================================================
+ * Headless decoder functions =================================================
+ * ==========================================================================*/
+
+/*
+ * curskey_decode() turns raw terminal input into keycodes without curses,
+ * e.g. for input received over the network. It does not need initscr() or
+ * curskey_init() and has no global state. It knows the sequences of xterm,
+ * rxvt and the Linux console, the kitty keyboard protocol and
+ * modifyOtherKeys, and decodes bracketed paste, mouse, focus and resize
+ * reports as if all options were enabled, except **CURSKEY_OPT_UTF8**;
+ * the keycodes are the same as those of curskey_wgetch().
+ */
+
+/// State of curskey_decode(), one per input stream. Zero-initialize it or
+/// use curskey_decoder_init().
+struct curskey_decoder {
+	unsigned char pending[CURSKEY_DECODER_PENDING]; ///< Incomplete sequence
+	int len;        ///< Number of pending bytes
+	int paste;      ///< Inside of a bracketed paste
+	int key_return; ///< Keycode of Return, '\\n' if zero
+};
+
+/**
+ * @brief Initialize the state of curskey_decode()
+ *
+ * @param key_return  The keycode returned for Return, like **KEY_RETURN**
+ *                    for curskey_wgetch(). Zero means '\\n'.
+ */
+void curskey_decoder_init(struct curskey_decoder *state, int key_return) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Decode terminal input
+ *
+ * An incomplete escape sequence at the end of `bytes` is kept in `state`
+ * and completed by the next call. If no more bytes arrive within the
+ * ESC delay, call curskey_decode_flush() to read it as it is.
+ *
+ * Carriage return is returned as the `key_return` of `state`, which does
+ * not depend on the global **KEY_RETURN**.
+ *
+ * A bracketed paste is reported as **KEY_PASTE**, followed by each byte
+ * of the pasted text as keycode 0..255, followed by **KEY_PASTE** again.
+ *
+ * Reentrant and allocation-free.
+ *
+ * @param bytes  The input
+ * @param n      Length of `bytes`
+ * @param state  State of the input stream
+ * @param keys   Receives the keycodes, needs room for
+ *               `n` + **CURSKEY_DECODER_PENDING** keys
+ *
+ * @return Number of keys stored
+ */
+int curskey_decode(const unsigned char *bytes, size_t n,
+	struct curskey_decoder *state, int *keys) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Decode the pending bytes of `state` as they are
+ *
+ * A lone ESC becomes **KEY_ESCAPE**, the bytes of an incomplete sequence
+ * become meta keys or characters.
+ *
+ * @param keys  Receives the keycodes, needs room for
+ *              **CURSKEY_DECODER_PENDING** keys
+ *
+ * @return Number of keys stored
+ */
+int curskey_decode_flush(struct curskey_decoder *state, int *keys) CURSES_LIB_NOEXCEPT;
+
+/* ============================================================================
+ * Context functions ==========================================================
+ * ==========================================================================*/
+
+/*
+ * A context holds the state of one terminal session: **KEY_RETURN**, the
+ * options and input buffers of the decoder, the created color pairs and
+ * the buffers of the functions returning strings. Each function below is
+ * the counterpart of the function without the _ctx suffix, which uses the
+ * default context. A server using newterm() per client creates one
+ * context per SCREEN; functions that talk to curses operate on the
+ * current SCREEN (set_term()).
+ */
+
+struct curskey_ctx;
+
+/**
+ * @brief Return the context used by the functions without _ctx suffix
+ *
+ * Its **KEY_RETURN** is the global variable of that name. The context is
+ * initialized statically, so any thread may call this at any time.
+ */
+struct curskey_ctx* curskey_ctx_default() CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Create a context
+ *
+ * The options are disabled, **KEY_RETURN** is '\\n' and the decoder
+ * reads from **STDIN_FILENO**. Nothing shared is touched, so threads may
+ * create their contexts concurrently.
+ *
+ * @return The context or NULL if out of memory
+ */
+struct curskey_ctx* curskey_ctx_new() CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Free a context
+ *
+ * Call curskey_disable_ctx() before, while its terminal is still there.
+ * The default context cannot be freed.
+ */
+void curskey_ctx_free(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Set the keycode of RETURN for a context
+ * @see KEY_RETURN
+ */
+void curskey_ctx_set_return(struct curskey_ctx *ctx, int keycode) CURSES_LIB_NOEXCEPT;
+
+/// curskey_init() for `ctx`, enabling the keypad of `win` instead of stdscr
+int curskey_init_ctx(struct curskey_ctx *ctx, WINDOW *win) CURSES_LIB_NOEXCEPT;
+int curskey_enable_ctx(struct curskey_ctx *ctx, unsigned int options) CURSES_LIB_NOEXCEPT;
+int curskey_disable_ctx(struct curskey_ctx *ctx, unsigned int options) CURSES_LIB_NOEXCEPT;
+int curskey_escdelay_ctx(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+int curskey_term_size_ctx(struct curskey_ctx *ctx, int *rows, int *cols) CURSES_LIB_NOEXCEPT;
+
+int curskey_parse_ctx(struct curskey_ctx *ctx, const char *keydef) CURSES_LIB_NOEXCEPT;
+int curskey_parse_n_ctx(struct curskey_ctx *ctx, const char *keydef, size_t len) CURSES_LIB_NOEXCEPT;
+int curskey_parse_many_ctx(struct curskey_ctx *ctx, const char *const *keydefs, int count,
+	int *keycodes, int *errors) CURSES_LIB_NOEXCEPT;
+int curskey_parse_lines_ctx(struct curskey_ctx *ctx, const char *buf, size_t len,
+	int *keycodes, int *errors, int max) CURSES_LIB_NOEXCEPT;
+/// The result stays valid until the next call with the same context
+const char* curskey_get_keydef_ctx(struct curskey_ctx *ctx, int keycode) CURSES_LIB_NOEXCEPT;
+
+int curskey_wgetch_ctx(struct curskey_ctx *ctx, WINDOW *win) CURSES_LIB_NOEXCEPT;
+int curskey_wget_wch_ctx(struct curskey_ctx *ctx, WINDOW *win) CURSES_LIB_NOEXCEPT;
+int curskey_wgetch_batch_ctx(struct curskey_ctx *ctx, WINDOW *win, int *keys, int max) CURSES_LIB_NOEXCEPT;
+int curskey_wgetch_repeat_ctx(struct curskey_ctx *ctx, WINDOW *win, int *repeat) CURSES_LIB_NOEXCEPT;
+const char* curskey_paste_ctx(struct curskey_ctx *ctx, size_t *len) CURSES_LIB_NOEXCEPT;
+int curskey_input_fd_ctx(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+int curskey_set_input_fd_ctx(struct curskey_ctx *ctx, int fd) CURSES_LIB_NOEXCEPT;
+void curskey_set_output_ctx(struct curskey_ctx *ctx, FILE *output) CURSES_LIB_NOEXCEPT;
+int curskey_fill_ctx(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+int curskey_feed_ctx(struct curskey_ctx *ctx, const char *bytes, size_t len) CURSES_LIB_NOEXCEPT;
+int curskey_drain_ctx(struct curskey_ctx *ctx, int *keys, int max, int *timeout) CURSES_LIB_NOEXCEPT;
+int curskey_record_ctx(struct curskey_ctx *ctx, int fd) CURSES_LIB_NOEXCEPT;
+int curskey_latency_ctx(struct curskey_ctx *ctx, int key_class, struct curskey_latency *stats) CURSES_LIB_NOEXCEPT;
+void curskey_latency_reset_ctx(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+int curskey_thread_start_ctx(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+int curskey_thread_stop_ctx(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+int curskey_thread_fd_ctx(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+int curskey_thread_drain_ctx(struct curskey_ctx *ctx, struct curskey_event *events, int max) CURSES_LIB_NOEXCEPT;
+
+/// The result stays valid until the next call with the same context
+const char* curses_color_tostring_ctx(struct curskey_ctx *ctx, short color) CURSES_LIB_NOEXCEPT;
+int curses_create_color_pair_ctx(struct curskey_ctx *ctx, short fg, short bg) CURSES_LIB_NOEXCEPT;
+void curses_reset_color_pairs_ctx(struct curskey_ctx *ctx) CURSES_LIB_NOEXCEPT;
+
+/* ============================================================================
+ * Keymap functions ===========================================================
+ * ==========================================================================*/
+
+#define CURSKEY_KEYMAP_PAGES \
+	((CURSKEY_KEY_MAX + CURSKEY_KEYMAP_PAGE_SIZE) / CURSKEY_KEYMAP_PAGE_SIZE)
+
+/// Binding of a keycode above **CURSKEY_KEY_MAX**, see curskey_keymap
+struct curskey_keymap_entry {
+	int keycode; ///< 0 if the slot is unused
+	void *data;
+};
+
+/**
+ * @brief Maps keycodes to user data.
+ *
+ * The keycodes are split into pages of **CURSKEY_KEYMAP_PAGE_SIZE** keys,
+ * a page is only allocated if one of its keys is bound. Extended keycodes
+ * above **CURSKEY_KEY_MAX** (curskey_ext_key(), curskey_ext_char(),
+ * curskey_mouse()) are kept in a hash table.
+ *
+ * Initialize it with `{0}` or curskey_keymap_init(), release it with
+ * curskey_keymap_free().
+ */
+struct curskey_keymap {
+	void **pages[CURSKEY_KEYMAP_PAGES];
+	struct curskey_keymap_entry *ext; ///< Open addressing
+	int ext_count;                    ///< Used slots
+	int ext_size;                     ///< Slots, a power of 2
+};
+
+/**
+ * @brief Initialize an empty keymap.
+ */
+void curskey_keymap_init(struct curskey_keymap *map) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Free all memory held by the keymap, leaving it empty.
+ */
+void curskey_keymap_free(struct curskey_keymap *map) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Bind `data` to `keycode`. Passing **NULL** unbinds the key.
+ * @return **OK** on success, **ERR** if the keycode is invalid or
+ *         memory could not be allocated
+ */
+int curskey_keymap_bind(struct curskey_keymap *map, int keycode, void *data) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Parse `count` key definitions and bind them to the corresponding
+ *        entries of `data`.
+ * @return The number of definitions that could not be bound
+ */
+int curskey_keymap_bind_many(struct curskey_keymap *map,
+	const char *const *keydefs, void *const *data, int count) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Return the data bound to an extended keycode above
+ *        **CURSKEY_KEY_MAX**, used by curskey_keymap_get().
+ */
+void* curskey_keymap_get_ext(const struct curskey_keymap *map, int keycode) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Return the data bound to `keycode` or **NULL** if it is not bound.
+ */
+static inline void* curskey_keymap_get(const struct curskey_keymap *map, int keycode)
+	CURSES_LIB_NOEXCEPT
+{
+	void **page;
+
+	if (keycode < 0)
+		return NULL;
+	if (keycode > CURSKEY_KEY_MAX)
+		return curskey_keymap_get_ext(map, keycode);
+
+	page = map->pages[keycode / CURSKEY_KEYMAP_PAGE_SIZE];
+	return page ? page[keycode % CURSKEY_KEYMAP_PAGE_SIZE] : NULL;
+}
+
+/* ============================================================================
+ * Key sequence functions =====================================================
+ * ==========================================================================*/
+
+/**
+ * @brief Parse a space separated sequence of key definitions ("C-x C-s").
+ *
+ * Stores at most `max` keycodes in `keycodes`.
+ *
+ * @return The number of keys or **ERR** if a key definition is invalid
+ *         or the sequence holds more than `max` keys
+ */
+int curskey_parse_seq(const char *keyseq, int *keycodes, int max) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Matches typed keys against a set of bound key sequences.
+ *
+ * The bound sequences are compiled into a trie whose transitions are held
+ * in a single hash table, so feeding a key costs the same no matter how
+ * many sequences are bound.
+ */
+struct curskey_chords;
+
+/**
+ * @brief Create an empty set of key sequences.
+ *
+ * A typed prefix is discarded if no key follows within `timeout` milliseconds.
+ * Pass -1 to wait forever.
+ *
+ * @return The new set or **NULL** if memory could not be allocated
+ */
+struct curskey_chords* curskey_chords_new(int timeout) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Free a set of key sequences.
+ */
+void curskey_chords_free(struct curskey_chords *chords) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Bind `data` to a key sequence given as string ("C-x C-s").
+ *
+ * The sequence may hold up to **CURSKEY_CHORD_KEYS_MAX** keys, use
+ * curskey_chords_bind_keys() for longer ones.
+ *
+ * @return **OK** on success, **ERR** on invalid sequence or memory failure
+ */
+int curskey_chords_bind(struct curskey_chords *chords, const char *keyseq, void *data) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Bind `data` to a key sequence given as array of keycodes.
+ * @return **OK** on success, **ERR** on invalid sequence or memory failure
+ */
+int curskey_chords_bind_keys(struct curskey_chords *chords,
+	const int *keycodes, int count, void *data) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Feed a typed key into the matcher.
+ *
+ * On **CURSKEY_CHORD_MATCH** the bound data is stored in `data` and the
+ * matcher starts over. A sequence that is bound and also a prefix of a
+ * longer sequence yields **CURSKEY_CHORD_PREFIX**; feed **ERR** (as returned
+ * by a timed out curskey_getch()) to accept it.
+ *
+ * If a key does not continue the typed prefix, or arrives after it timed
+ * out, the key is matched from the start. If the prefix itself is bound,
+ * its data is stored in `data` first and **CURSKEY_CHORD_REPLAY** is
+ * returned; feed the same key again to match it.
+ *
+ * @return One of \ref CHORD_RESULTS
+ */
+int curskey_chords_feed(struct curskey_chords *chords, int keycode, void **data) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Milliseconds until the typed prefix expires.
+ *
+ * Suitable for passing to **wtimeout()**.
+ *
+ * @return Milliseconds or -1 if there is no prefix pending or no timeout set
+ */
+int curskey_chords_timeout(const struct curskey_chords *chords) CURSES_LIB_NOEXCEPT;
+
+/**
+ * @brief Discard the typed prefix.
+ */
+void curskey_chords_reset(struct curskey_chords *chords) CURSES_LIB_NOEXCEPT;
+
 /* ============================================================================
  * Color functions ============================================================
  * ==========================================================================*/
@@ -222,12 +1168,29 @@ int curskey_wgetch(WINDOW*) CURSES_LIB_NOEXCEPT;
  */
 short curses_color_parse(const char* s) CURSES_LIB_NOEXCEPT;
 
+/**
+ * @brief Like curses_color_parse(), but takes the length of the string.
+ */
+short curses_color_parse_n(const char* s, size_t len) CURSES_LIB_NOEXCEPT;
+
 /**
  * @brief Get string for a curses color
  * @return string or **NULL** on error
  */
 const char* curses_color_tostring(short color) CURSES_LIB_NOEXCEPT;
 
+/**
+ * @brief Reentrant version of curses_color_tostring().
+ *
+ * Writes the color string including the terminating NUL into `buf`.
+ *
+ * Only reads constant tables, so it may be called from several threads at
+ * once without locking.
+ *
+ * @return Length of the string or **ERR** on error or if `buf` is too small
+ */
+int curses_color_tostring_r(short color, char *buf, size_t size) CURSES_LIB_NOEXCEPT;
+
 /* ============================================================================
  * Attribute functions ========================================================
  * ==========================================================================*/
@@ -245,6 +1208,11 @@ const char* curses_color_tostring(short color) CURSES_LIB_NOEXCEPT;
  */
 unsigned int curses_attr_parse(const char* s) CURSES_LIB_NOEXCEPT;
 
+/**
+ * @brief Like curses_attr_parse(), but takes the length of the string.
+ */
+unsigned int curses_attr_parse_n(const char* s, size_t len) CURSES_LIB_NOEXCEPT;
+
 /**
  * @brief  Get string for a curses attribute
  * @return String or **NULL** on error
@@ -277,11 +1245,220 @@ template<class String> inline short curses_color_parse(const String& color)
 
 template<class String> inline unsigned int curses_attr_parse(const String& attribute)
 	CURSES_LIB_NOEXCEPT
-{ return curses_color_parse(attribute.c_str()); }
+{ return curses_attr_parse(attribute.c_str()); }
 
 template<class String> inline int curskey_parse(const String& keydef)
 	CURSES_LIB_NOEXCEPT
 { return curskey_parse(keydef.c_str()); }
+
+#if __cplusplus >= 201703L
+#include <string_view>
+
+inline short curses_color_parse(std::string_view color)
+	CURSES_LIB_NOEXCEPT
+{ return curses_color_parse_n(color.data(), color.size()); }
+
+inline unsigned int curses_attr_parse(std::string_view attribute)
+	CURSES_LIB_NOEXCEPT
+{ return curses_attr_parse_n(attribute.data(), attribute.size()); }
+
+inline int curskey_parse(std::string_view keydef)
+	CURSES_LIB_NOEXCEPT
+{ return curskey_parse_n(keydef.data(), keydef.size()); }
+#endif
+#endif
+
+/* ============================================================================
+ * C++ compile time parsing ===================================================
+ * ==========================================================================*/
+
+#if defined(__cplusplus) && __cplusplus >= 201402L
+#ifdef __cpp_consteval
+#define CURSKEY_CONSTEVAL consteval
+#else
+#define CURSKEY_CONSTEVAL constexpr
+#endif
+
+namespace curskey_detail {
+
+struct keyname { const char *name; int keycode; };
+
+#define CURSKEY_DETAIL_KEYNAME(NAME, KEYCODE) { NAME, KEYCODE },
+#define CURSKEY_DETAIL_CURSES_KEYNAME(NAME) { #NAME, KEY_##NAME },
+constexpr keyname keynames[] = { CURSKEY_KEYNAMES(CURSKEY_DETAIL_KEYNAME) };
+constexpr keyname curses_keynames[] = { CURSKEY_CURSES_KEYNAMES(CURSKEY_DETAIL_CURSES_KEYNAME) };
+#undef CURSKEY_DETAIL_KEYNAME
+#undef CURSKEY_DETAIL_CURSES_KEYNAME
+
+constexpr char lower(char c) noexcept
+{ return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+constexpr bool iequal(const char *s, size_t len, const char *name) noexcept
+{
+	for (size_t i = 0; i < len; ++i)
+		if (! name[i] || lower(s[i]) != lower(name[i]))
+			return false;
+	return name[len] == '\0';
+}
+
+// Not constexpr: Reaching this during constant evaluation is a compile error.
+inline int invalid_keydef() noexcept { return ERR; }
+
+constexpr int keycode(const char *s, size_t len) noexcept
+{
+	if (len >= 4 && lower(s[0]) == 'k' && lower(s[1]) == 'e' &&
+		lower(s[2]) == 'y' && s[3] == '_') {
+		s += 4;
+		len -= 4;
+	}
+
+	if (iequal(s, len, "RETURN"))
+		return '\n';
+
+	for (const keyname& key : keynames)
+		if (iequal(s, len, key.name))
+			return key.keycode;
+
+	if (len >= 2 && lower(s[0]) == 'f') {
+		size_t i = (s[1] == '(' ? 2 : 1);
+		int f = 0;
+		for (; i < len && s[i] >= '0' && s[i] <= '9' && f <= 63; ++i)
+			f = f * 10 + (s[i] - '0');
+		if (f >= 1 && f <= 63)
+			return KEY_F(f);
+	}
+
+	for (const keyname& key : curses_keynames)
+		if (iequal(s, len, key.name))
+			return key.keycode;
+
+	return ERR;
+}
+
+// The character of a UTF-8 key definition, ERR unless it is exactly one
+// character above 127
+constexpr int utf8_char(const char *s, size_t len) noexcept
+{
+	const unsigned char lead = static_cast<unsigned char>(s[0]);
+	const size_t n = (lead >= 0xC2 && lead <= 0xDF) ? 2
+		: (lead >= 0xE0 && lead <= 0xEF) ? 3
+		: (lead >= 0xF0 && lead <= 0xF4) ? 4 : 0;
+	int c = lead & (n == 2 ? 0x1F : n == 3 ? 0x0F : 0x07);
+
+	if (! n || n != len)
+		return ERR;
+	for (size_t i = 1; i < n; ++i) {
+		if ((static_cast<unsigned char>(s[i]) & 0xC0) != 0x80)
+			return ERR;
+		c = (c << 6) | (s[i] & 0x3F);
+	}
+
+	// Overlong encodings, surrogates and characters above U+10FFFF
+	if ((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10FFFF))
+			|| (c >= 0xD800 && c <= 0xDFFF))
+		return ERR;
+	return c;
+}
+
+// curskey_ext_key() for Super- and Hyper-, which no legacy keycode holds
+constexpr int ext_key(int key, unsigned int mod) noexcept
+{
+	if (key >= 0 && key < ' ' && key != KEY_ESCAPE && key != KEY_TAB && key != '\n') {
+		key = (key == 0 ? ' ' : key + 'A' - 1);
+		mod |= CURSKEY_MOD_CTRL;
+	}
+	if (key >= 'A' && key <= 'Z') {
+		key += 'a' - 'A';
+		mod |= CURSKEY_MOD_SHIFT;
+	}
+
+	if (key >= KEY_MIN && key <= KEY_MAX)
+		key += CURSKEY_EXT_KEYS;
+	else if (key < 0 || key > CURSKEY_META_RANGE)
+		return ERR;
+
+	return curskey_ext_char(key, mod);
+}
+
+constexpr int parse(const char *s, size_t len) noexcept
+{
+	unsigned int mod = 0;
+	int c = ERR;
+
+	for (;;) {
+		if (len >= 2 && s[0] == '^') {
+			s += 1; len -= 1; mod |= CURSKEY_MOD_CTRL;
+		}
+		else if (len >= 2 && s[1] == '-' && lower(s[0]) == 'c') {
+			s += 2; len -= 2; mod |= CURSKEY_MOD_CTRL;
+		}
+		else if (len >= 2 && s[1] == '-' && (lower(s[0]) == 'm' || lower(s[0]) == 'a')) {
+			s += 2; len -= 2; mod |= CURSKEY_MOD_META;
+		}
+		else if (len >= 2 && s[1] == '-' && lower(s[0]) == 's') {
+			s += 2; len -= 2; mod |= CURSKEY_MOD_SHIFT;
+		}
+		else if (len >= 6 && iequal(s, 6, "super-")) {
+			s += 6; len -= 6; mod |= CURSKEY_MOD_SUPER;
+		}
+		else if (len >= 6 && iequal(s, 6, "hyper-")) {
+			s += 6; len -= 6; mod |= CURSKEY_MOD_HYPER;
+		}
+		else
+			break;
+	}
+
+	if (len == 1)
+		c = s[0];
+	else if (len > 1 && static_cast<unsigned char>(s[0]) >= 0x80) {
+		// Characters above 127 have no legacy keycode
+		if ((c = utf8_char(s, len)) != ERR)
+			return curskey_ext_char(c, mod);
+	}
+	else if (len > 1)
+		c = keycode(s, len);
+
+	if (c != ERR && (mod & (CURSKEY_MOD_SUPER|CURSKEY_MOD_HYPER)))
+		c = ext_key(c, mod);
+	else if (c != ERR)
+		c = curskey_mod_key(c, mod);
+
+	return (c != ERR ? c : invalid_keydef());
+}
+
+} // namespace curskey_detail
+
+/**
+ * @brief Compile time version of curskey_parse().
+ *
+ * Supports single characters, UTF-8 characters, the modifiers including
+ * Super- and Hyper-, F1-F63 and the same key names as curskey_parse(),
+ * including those of curses (BTAB, SRIGHT). Invalid key definitions are
+ * compile errors when evaluated at compile time.
+ *
+ * The result is that of curskey_parse() with **CURSKEY_OPT_KITTY** and
+ * **CURSKEY_OPT_MODIFY_OTHER_KEYS** disabled, except that Super- and
+ * Hyper- give the extended keycode. Combinations that only have an
+ * extended keycode otherwise (C-TAB, C-RETURN) do not compile.
+ *
+ * @note RETURN always yields '\\n', the default of **KEY_RETURN**.
+ */
+constexpr int curskey_parse_constexpr(const char *keydef, size_t len) noexcept
+{ return curskey_detail::parse(keydef, len); }
+
+inline namespace curskey_literals {
+/**
+ * @brief User defined literal for curskey_parse_constexpr().
+ *
+ * \code{.cpp}
+ *       switch (curskey_getch()) {
+ *       case "C-M-r"_key: ...
+ *       }
+ * \endcode
+ */
+CURSKEY_CONSTEVAL int operator""_key(const char *keydef, size_t len) noexcept
+{ return curskey_detail::parse(keydef, len); }
+} // namespace curskey_literals
 #endif
 
 #endif /* CURSKEY_H_ */
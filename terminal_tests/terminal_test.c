@@ -7,7 +7,7 @@
 #include <sys/wait.h>
 
 #define USAGE \
-	"Usage: %s -o OUTFILE [-b BLACKLIST KEY]\n"
+	"Usage: %s [-k|-m] -o OUTFILE [-b BLACKLIST KEY]\n"
 #undef  CTRL  //usr/include/sys/ttydefaults.h defines this
 #define ALT   CURSKEY_MOD_META
 #define CTRL  CURSKEY_MOD_CTRL
@@ -26,11 +26,32 @@ static struct {
 	int         count;
 } RESULTS;
 
+static unsigned opt_ext_keys; // CURSKEY_OPT_KITTY or CURSKEY_OPT_MODIFY_OTHER_KEYS
+
 static void add_test(int key, int mod) {
 	RESULTS.count[RESULTS.keycode] = curskey_mod_key(key, mod);
 	RESULTS.count++;
 }
 
+// Keys only distinguishable with extended key reports
+static void add_ext_test(int key, int mod) {
+	RESULTS.count[RESULTS.keycode] = curskey_ext_key(key, mod);
+	RESULTS.count++;
+}
+
+static void add_ext_tests() {
+	int c;
+	for (c = 'a'; c <= 'z'; ++c) add_ext_test(c, CTRL|SHIFT);
+	for (c = '0'; c <= '9'; ++c) add_ext_test(c, CTRL);
+	add_ext_test(KEY_TAB,    CTRL);
+	add_ext_test(KEY_TAB,    CTRL|SHIFT);
+	add_ext_test(KEY_RETURN, CTRL);
+	add_ext_test(KEY_RETURN, SHIFT);
+	add_ext_test(KEY_RETURN, ALT|CTRL);
+	add_ext_test(KEY_ESCAPE, CTRL);
+	add_ext_test(KEY_SPACE,  SHIFT);
+}
+
 static void add_blacklist(int key_modded) {
 	for (int i = 0; i < RESULTS.count; ++i)
 		if (RESULTS.keycode[i] == key_modded)
@@ -39,6 +60,8 @@ static void add_blacklist(int key_modded) {
 
 static const char* curses_keysm_to_X11_keysym_str(int key) {
 	static char buf[8];
+	if (key == KEY_RETURN)
+		return "Return";
 	switch (key) {
 	case KEY_SPACE:     return "space";
 	case KEY_TAB:       return "Tab";
@@ -55,7 +78,6 @@ static const char* curses_keysm_to_X11_keysym_str(int key) {
 	case KEY_END:       return "End";
 	case KEY_IC:        return "Insert";
 	case KEY_DC:        return "Delete";
-//case KEY_RETURN:    return "Return"; TODO
 	default:
 		if (key >= KEY_F(1) && key <= KEY_F(63))
 			sprintf(buf, "F%d", key - KEY_F(0));
@@ -84,13 +106,18 @@ static int X11_send_key(int key, int mod) {
 	}
 }
 
+// With extended key reports the input is buffered by curskey's decoder
+static int read_key() {
+	return (opt_ext_keys ? curskey_getch() : getch());
+}
+
 static void eat_keys(char* buffer, int bufsize) {
-	int c = getch();
+	int c = read_key();
 	if (c != ERR) {
 		wtimeout(stdscr, 0);
 		*buffer++ = c;
 		--bufsize;
-		while ((c = getch()) != ERR)
+		while ((c = read_key()) != ERR)
 			if (bufsize >= 1) {
 				*buffer++ = c;
 				--bufsize;
@@ -103,6 +130,13 @@ static void run_get_keydefs() {
 	char keyseq[32];
 
 	keypad(stdscr, FALSE);
+	if (opt_ext_keys) {
+		// Record the raw sequences, but keep the terminal reporting them
+		curskey_disable(CURSKEY_OPT_DECODER);
+		putp(opt_ext_keys == CURSKEY_OPT_KITTY ? "\033[>1u" : "\033[>4;2m");
+		fflush(stdout);
+		opt_ext_keys = 0;
+	}
 	napms(500); // The terminal driver needs some time after `keypad()`
 
 	for (int i = 0; i < RESULTS.count; ++i) {
@@ -265,8 +299,10 @@ int main(int argc, char**argv) {
 	 * Commandline ==============================================================
 	 * ========================================================================*/
 
-	for (int opt; (opt = getopt(argc, argv, "b:o:")) != -1;)
+	for (int opt; (opt = getopt(argc, argv, "kmb:o:")) != -1;)
 		switch (opt) {
+			case 'k': opt_ext_keys = CURSKEY_OPT_KITTY; add_ext_tests(); break;
+			case 'm': opt_ext_keys = CURSKEY_OPT_MODIFY_OTHER_KEYS; add_ext_tests(); break;
 			case 'o': OUTFILE = optarg; break;
 			case 'b': add_blacklist(curskey_parse(optarg)); break;
 			default:  return printf(USAGE, argv[0]), 1;
@@ -279,6 +315,8 @@ int main(int argc, char**argv) {
 	initscr();
 	scrollok(stdscr, TRUE);
 	curskey_init();
+	if (opt_ext_keys)
+		curskey_enable(opt_ext_keys);
 	noecho();
 	wtimeout(stdscr, 1000); // Give the terminal 1 sec for initialization.
   char trash;
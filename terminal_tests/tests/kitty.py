@@ -7,4 +7,6 @@ class Test(ATest):
         return which('kitty')
 
     def run(self, args):
+        # Test with the kitty keyboard protocol enabled
+        args = args[0:1] + ['-k'] + args[1:]
         subprocess.call(['kitty', '-o', 'clear_all_shortcuts=yes', '-e'] + args)
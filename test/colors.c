@@ -58,6 +58,27 @@ int main() {
 	assert(curses_color_parse("no_color")         == COLOR_INVALID);
 	assert(curses_color_parse("256")              == COLOR_INVALID);
 	assert(curses_color_parse("-2")               == COLOR_INVALID);
+	assert(curses_color_parse("-1")               == -1);
+	assert(curses_color_parse("-")                == COLOR_INVALID);
+	assert(curses_color_parse("12a")              == COLOR_INVALID);
+	assert(curses_color_parse(" 12")              == 12);
+	assert(curses_color_parse("\t-1")             == -1);
+	assert(curses_color_parse("+7")               == 7);
+	assert(curses_color_parse("+")                == COLOR_INVALID);
+	assert(curses_color_parse("+-1")              == COLOR_INVALID);
+	assert(curses_color_parse(" ")                == COLOR_INVALID);
+	assert(curses_color_parse("12 ")              == COLOR_INVALID);
+
+	// ========================================================================
+	// curses_color_parse_n() / curses_attr_parse_n() =========================
+	// ========================================================================
+
+	assert(curses_color_parse_n("redx", 3)        == COLOR_RED);
+	assert(curses_color_parse_n("red", 2)         == COLOR_INVALID);
+	assert(curses_color_parse_n("2559", 3)        == 255);
+	assert(curses_color_parse_n("", 0)            == COLOR_INVALID);
+	assert(curses_attr_parse_n("boldx", 4)        == A_BOLD);
+	assert(curses_attr_parse_n("bold", 3)         == A_INVALID);
 
 	// ========================================================================
 	// curses_color_tostring() ================================================
@@ -74,6 +95,19 @@ int main() {
 	assert(streq(curses_color_tostring(COLOR_MAGENTA) , "magenta"));
 	assert(streq(curses_color_tostring(123)           , "123"));
 
+	// ========================================================================
+	// curses_color_tostring_r() ==============================================
+	// ========================================================================
+
+	char buf[8];
+	assert(curses_color_tostring_r(-1,  buf, sizeof(buf)) == 7 && streq(buf, "default"));
+	assert(curses_color_tostring_r(123, buf, sizeof(buf)) == 3 && streq(buf, "123"));
+	assert(curses_color_tostring_r(8,   buf, sizeof(buf)) == 1 && streq(buf, "8"));
+	assert(curses_color_tostring_r(123, buf, 4)           == 3 && streq(buf, "123"));
+	assert(curses_color_tostring_r(123, buf, 3)           == ERR);
+	assert(curses_color_tostring_r(-1,  buf, 7)           == ERR);
+	assert(curses_color_tostring_r(-2,  buf, sizeof(buf)) == ERR);
+
 	// ========================================================================
 	// curses_create_color_pair() =============================================
 	// ========================================================================
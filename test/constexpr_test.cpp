@@ -0,0 +1,59 @@
+#include "../curskey.h"
+
+#undef  CTRL    //usr/include/sys/ttydefaults.h defines this
+#define META	CURSKEY_MOD_META
+#define CTRL	CURSKEY_MOD_CTRL
+#define SHIFT   CURSKEY_MOD_SHIFT
+#define SUPER   CURSKEY_MOD_SUPER
+#define HYPER   CURSKEY_MOD_HYPER
+
+// Everything in here is checked at compile time.
+
+static_assert('a'                                == "a"_key,           "");
+static_assert(1                                  == "^a"_key,          "");
+static_assert(1                                  == "C-a"_key,         "");
+static_assert(1                                  == "c-A"_key,         "");
+static_assert(0                                  == "C-SPACE"_key,     "");
+static_assert(curskey_mod_key('r', CTRL|META)    == "C-M-r"_key,       "");
+static_assert(curskey_mod_key('r', CTRL|META)    == "M-^r"_key,        "");
+static_assert(curskey_mod_key('a', META)         == "A-a"_key,         "");
+static_assert(curskey_mod_key('a', SHIFT)        == "S-a"_key,         "");
+static_assert(curskey_mod_key(KEY_LEFT, CTRL)    == "C-LEFT"_key,      "");
+static_assert(curskey_mod_key(KEY_TAB, META)     == "M-TAB"_key,       "");
+static_assert('\n'                               == "RETURN"_key,      "");
+static_assert(KEY_ESCAPE                         == "ESCAPE"_key,      "");
+static_assert(KEY_BACKSPACE                      == "BACKSPACE"_key,   "");
+static_assert(KEY_DC                             == "DELETE"_key,      "");
+static_assert(KEY_HOME                           == "KEY_HOME"_key,    "");
+static_assert(KEY_HOME                           == "home"_key,        "");
+static_assert(KEY_NPAGE                          == "PAGEDOWN"_key,    "");
+static_assert(KEY_F(1)                           == "F1"_key,          "");
+static_assert(KEY_F(12)                          == "KEY_F(12)"_key,   "");
+static_assert(KEY_F(63)                          == "F63"_key,         "");
+static_assert(KEY_BTAB                           == "BTAB"_key,        "");
+static_assert(KEY_BTAB                           == "KEY_BTAB"_key,    "");
+static_assert(curskey_mod_key(KEY_SRIGHT, META)  == "M-SRIGHT"_key,    "");
+static_assert(KEY_ENTER                          == "ENTER"_key,       "");
+static_assert(KEY_FOCUS_IN                       == "FocusIn"_key,     "");
+static_assert(curskey_ext_char('a', SUPER)      == "Super-a"_key,     "");
+static_assert(curskey_ext_char('a', SUPER|SHIFT) == "super-A"_key,     "");
+static_assert(curskey_ext_char('x', CTRL|HYPER)  == "C-Hyper-x"_key,   "");
+static_assert(curskey_ext_char(CURSKEY_EXT_KEYS + KEY_UP, SUPER) == "Super-UP"_key, "");
+static_assert(curskey_ext_char(0xE4, 0)          == "\xC3\xA4"_key,    "");
+static_assert(curskey_ext_char(0xE4, META)       == "M-\xC3\xA4"_key,  "");
+static_assert(curskey_ext_char(0x20AC, CTRL)     == "C-\xE2\x82\xAC"_key, "");
+static_assert(curskey_ext_char(0x1F600, 0)       == "\xF0\x9F\x98\x80"_key, "");
+static_assert(KEY_HOME == curskey_parse_constexpr("HOMEX", 4),        "");
+
+// These do not compile:
+//   "C-TAB"_key, "F64"_key, "KEY_FOO"_key, ""_key, "\xC3"_key
+
+int main() {
+	switch (curskey_parse_constexpr("C-x", 3)) {
+	case "C-x"_key: return 0;
+	case "C-M-x"_key: return 1;
+	default: return 1;
+	}
+}
+
+/* vim: set ts=4 sw=4 : */
@@ -4,6 +4,9 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <locale.h>
 #include "../curskey.h"
 
 int count = 0;					// Test count
@@ -61,6 +64,7 @@ static int streq(const char *a, const char *b) {
 
 void do_tests() {
 	char buf[128];
+	int i, n;
 
 #define test test_int
 
@@ -216,6 +220,82 @@ void do_tests() {
 	test (KEY_F(63),       curskey_parse("F63"));
 	test (ERR,             curskey_parse("F64"));
 
+	// ncurses keys without alias
+	test (KEY_BTAB,        curskey_parse("BTAB"));
+	test (KEY_BTAB,        curskey_parse("KEY_BTAB"));
+	test (KEY_SRIGHT,      curskey_parse("SRIGHT"));
+	test (KEY_SRIGHT,      curskey_parse("key_sright"));
+	test (KEY_SR,          curskey_parse("SR"));
+	test (KEY_A1,          curskey_parse("A1"));
+	test (KEY_UNDO,        curskey_parse("UNDO"));
+	test (KEY_ENTER,       curskey_parse("ENTER"));
+	test (ERR,             curskey_parse("KEY_FOO"));
+	test (ERR,             curskey_parse("SRIGHTX"));
+
+	// ========================================================================
+	// curskey_parse_n() ======================================================
+	// ========================================================================
+
+	test (ERR,                           curskey_parse_n("a", 0));
+	test ('a',                           curskey_parse_n("abc", 1));
+	test ('^',                           curskey_parse_n("^a", 1));
+	test (1,                             curskey_parse_n("^a", 2));
+	test (ERR,                           curskey_parse_n("C-a", 2));
+	test (curskey_mod_key('r', CTRL|META), curskey_parse_n("C-M-rXYZ", 5));
+	test (KEY_HOME,                      curskey_parse_n("HOMEX", 4));
+	test (KEY_HOME,                      curskey_parse_n("KEY_HOME\0", 8));
+	test (ERR,                           curskey_parse_n("KEY_HOME", 7));
+	test ('\n',                          curskey_parse_n("RETURNX", 6));
+	test (KEY_F(1),                      curskey_parse_n("F12", 2));
+	test (KEY_F(12),                     curskey_parse_n("F(12)", 5));
+	test (KEY_BTAB,                      curskey_parse_n("BTABX", 4));
+
+	// ========================================================================
+	// curskey_parse_many() / curskey_parse_lines() ===========================
+	// ========================================================================
+
+	{
+		const char *defs[] = { "C-a", "", "KEY_FOO", "C-TAB", "F12" };
+		const char *text  = "C-a\n\nKEY_FOO\nC-TAB\nF12";
+		int keys[5];
+		int errors[5];
+
+		test (3,                     curskey_parse_many(defs, 5, keys, errors));
+		test (1,                     keys[0]);
+		test (OK,                    errors[0]);
+		test (ERR,                   keys[1]);
+		test (CURSKEY_ERR_EMPTY,     errors[1]);
+		test (ERR,                   keys[2]);
+		test (CURSKEY_ERR_KEYNAME,   errors[2]);
+		test (ERR,                   keys[3]);
+		test (CURSKEY_ERR_MODIFIER,  errors[3]);
+		test (KEY_F(12),             keys[4]);
+		test (OK,                    errors[4]);
+
+		test (5,                     curskey_parse_lines(text, strlen(text), keys, errors, 5));
+		test (1,                     keys[0]);
+		test (CURSKEY_ERR_EMPTY,     errors[1]);
+		test (CURSKEY_ERR_KEYNAME,   errors[2]);
+		test (CURSKEY_ERR_MODIFIER,  errors[3]);
+		test (KEY_F(12),             keys[4]);
+		test (2,                     curskey_parse_lines(text, strlen(text), keys, NULL, 2));
+		test (1,                     curskey_parse_lines("F1\n", 3, keys, errors, 5));
+		test (KEY_F(1),              keys[0]);
+		test (3,                     curskey_parse_lines("C-a\r\n\r\nF2\r\n", 11, keys, errors, 5));
+		test (1,                     keys[0]);
+		test (CURSKEY_ERR_EMPTY,     errors[1]);
+		test (KEY_F(2),              keys[2]);
+
+		// Names repeated within a batch
+		const char *repeated[] = { "LEFT", "M-left", "KEY_LEFT", "lEfT", "LEFTX" };
+		test (1,                     curskey_parse_many(repeated, 5, keys, errors));
+		test (KEY_LEFT,              keys[0]);
+		test (curskey_parse("M-LEFT"), keys[1]);
+		test (KEY_LEFT,              keys[2]);
+		test (KEY_LEFT,              keys[3]);
+		test (CURSKEY_ERR_KEYNAME,   errors[4]);
+	}
+
 #undef test
 #define test test_str
 	// curskey_keyname
@@ -240,6 +320,19 @@ void do_tests() {
 	test("F10",         curskey_get_keydef(KEY_F(10)));
 	test("F33",         curskey_get_keydef(KEY_F(33)));
 	test("F63",         curskey_get_keydef(KEY_F(63)));
+	test("DELETE",      curskey_get_keydef(KEY_DC));
+	test("PAGEUP",      curskey_get_keydef(KEY_PPAGE));
+	test("BTAB",        curskey_get_keydef(KEY_BTAB));
+	test("SRIGHT",      curskey_get_keydef(KEY_SRIGHT));
+#undef test
+
+#define test test_int
+	// Every named curses key parses back to itself
+	for (i = KEY_MIN, n = 0; i <= KEY_MAX; ++i)
+		n += (curskey_get_keydef(i) && curskey_parse(curskey_get_keydef(i)) != i);
+	test (0,            n);
+#undef test
+#define test test_str
 
 	// control characters [0 - 31]
     test("C-SPACE",     curskey_get_keydef(0));
@@ -291,6 +384,933 @@ void do_tests() {
 	test(NULL,          curskey_get_keydef(curskey_mod_key(KEY_ESCAPE,    CTRL)));
 
 	test(NULL,          curskey_get_keydef(KEY_MAX * 2));
+
+#undef test
+#define test test_int
+	// ========================================================================
+	// curskey_get_keydef_r() =================================================
+	// ========================================================================
+
+	test (3,   curskey_get_keydef_r(curskey_mod_key('a', META), buf, sizeof(buf)));
+	test_str ("M-a", buf);
+	test (8,   curskey_get_keydef_r(KEY_HOME|CTRL|META, buf, sizeof(buf)));
+	test_str ("C-M-HOME", buf);
+	test (4,   curskey_get_keydef_r(KEY_HOME, buf, 5));
+	test_str ("HOME", buf);
+	test (ERR, curskey_get_keydef_r(KEY_HOME, buf, 4));
+	test (ERR, curskey_get_keydef_r(KEY_MAX * 2, buf, sizeof(buf)));
+}
+
+void keymap_tests() {
+	struct curskey_keymap map = {{0}, NULL, 0, 0};
+	const char *defs[] = { "C-x", "F12", "C-M-HOME", "C-TAB" };
+	char *data[] = { "ctrl-x", "f12", "ctrl-meta-home", "invalid" };
+	int i, n;
+
+#undef test
+#define test test_str
+	test (NULL,             curskey_keymap_get(&map, 'a'));
+	test_int (OK,           curskey_keymap_bind(&map, 'a', "a"));
+	test ("a",              curskey_keymap_get(&map, 'a'));
+	test (NULL,             curskey_keymap_get(&map, 'b'));
+	test (NULL,             curskey_keymap_get(&map, -1));
+	test (NULL,             curskey_keymap_get(&map, CURSKEY_KEY_MAX + 1));
+	test_int (ERR,          curskey_keymap_bind(&map, ERR, "err"));
+	test_int (OK,           curskey_keymap_bind(&map, CURSKEY_KEY_MAX, "max"));
+	test ("max",            curskey_keymap_get(&map, CURSKEY_KEY_MAX));
+
+	// Extended keycodes
+	test_int (OK,           curskey_keymap_bind(&map, CURSKEY_KEY_MAX + 1, "max+1"));
+	test ("max+1",          curskey_keymap_get(&map, CURSKEY_KEY_MAX + 1));
+	test_int (OK,           curskey_keymap_bind(&map, curskey_ext_key('\t', CTRL), "ctrl-tab"));
+	test_int (OK,           curskey_keymap_bind(&map, curskey_ext_char(0xE4, 0), "a-umlaut"));
+	test_int (OK,           curskey_keymap_bind(&map, curskey_mouse(1, CURSKEY_MOUSE_PRESS, 0, 0, 0), "click"));
+	test ("ctrl-tab",       curskey_keymap_get(&map, curskey_ext_key('\t', CTRL)));
+	test ("a-umlaut",       curskey_keymap_get(&map, curskey_ext_char(0xE4, 0)));
+	test ("click",          curskey_keymap_get(&map, curskey_mouse(1, CURSKEY_MOUSE_PRESS, 0, 0, 0)));
+	test (NULL,             curskey_keymap_get(&map, curskey_ext_char(0xE4, CTRL)));
+	for (i = 0; i < 1000; ++i)
+		curskey_keymap_bind(&map, curskey_ext_char(0x1000 + i, META), data[i % 4]);
+	for (i = 0, n = 0; i < 1000; ++i)
+		n += (curskey_keymap_get(&map, curskey_ext_char(0x1000 + i, META)) == data[i % 4]);
+	test_int (1000,         n);
+	test ("ctrl-tab",       curskey_keymap_get(&map, curskey_ext_key('\t', CTRL)));
+	test_int (OK,           curskey_keymap_bind(&map, curskey_ext_key('\t', CTRL), NULL));
+	test (NULL,             curskey_keymap_get(&map, curskey_ext_key('\t', CTRL)));
+	test ("a-umlaut",       curskey_keymap_get(&map, curskey_ext_char(0xE4, 0)));
+
+	test_int (1,            curskey_keymap_bind_many(&map, defs, (void**) data, 4));
+	test ("ctrl-x",         curskey_keymap_get(&map, curskey_parse("C-x")));
+	test ("f12",            curskey_keymap_get(&map, KEY_F(12)));
+	test ("ctrl-meta-home", curskey_keymap_get(&map, KEY_HOME|META|CTRL));
+	test (NULL,             curskey_keymap_get(&map, KEY_HOME));
+
+	test_int (OK,           curskey_keymap_bind(&map, 'a', NULL));
+	test (NULL,             curskey_keymap_get(&map, 'a'));
+
+	curskey_keymap_free(&map);
+	test (NULL,             curskey_keymap_get(&map, KEY_F(12)));
+#undef test
+}
+
+void chord_tests() {
+	int keys[4];
+	void *data;
+	struct curskey_chords *chords = curskey_chords_new(-1);
+
+#define test test_int
+	// ========================================================================
+	// curskey_parse_seq() ====================================================
+	// ========================================================================
+
+	test (0,         curskey_parse_seq("", keys, 4));
+	test (1,         curskey_parse_seq("  a ", keys, 4));
+	test ('a',       keys[0]);
+	test (2,         curskey_parse_seq("C-x C-s", keys, 4));
+	test (24,        keys[0]);
+	test (19,        keys[1]);
+	test (3,         curskey_parse_seq("g  g  HOME", keys, 4));
+	test (KEY_HOME,  keys[2]);
+	test (ERR,       curskey_parse_seq("C-x C-TAB", keys, 4));
+	test (ERR,       curskey_parse_seq("a b c d e", keys, 4));
+
+	// ========================================================================
+	// curskey_chords_*() =====================================================
+	// ========================================================================
+
+	test (OK,  curskey_chords_bind(chords, "C-x C-s", "save"));
+	test (OK,  curskey_chords_bind(chords, "C-x C-c", "quit"));
+	test (OK,  curskey_chords_bind(chords, "g", "g"));
+	test (OK,  curskey_chords_bind(chords, "g g", "top"));
+	test (OK,  curskey_chords_bind(chords, "F1", "help"));
+	test (ERR, curskey_chords_bind(chords, "", "empty"));
+	test (ERR, curskey_chords_bind(chords, "C-x C-TAB", "invalid"));
+
+	test (CURSKEY_CHORD_NOMATCH, curskey_chords_feed(chords, 'a', &data));
+	test (-1,                    curskey_chords_timeout(chords));
+	test (CURSKEY_CHORD_MATCH,   curskey_chords_feed(chords, KEY_F(1), &data));
+	test_str ("help",            data);
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 24, &data));
+	test (CURSKEY_CHORD_MATCH,   curskey_chords_feed(chords, 19, &data));
+	test_str ("save",            data);
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 24, &data));
+	test (CURSKEY_CHORD_NOMATCH, curskey_chords_feed(chords, 'a', &data));
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 24, &data));
+	test (CURSKEY_CHORD_MATCH,   curskey_chords_feed(chords, 3, &data));
+	test_str ("quit",            data);
+
+	// A key not continuing the prefix is matched from the start
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 24, &data));
+	test (CURSKEY_CHORD_MATCH,   curskey_chords_feed(chords, KEY_F(1), &data));
+	test_str ("help",            data);
+
+	// "g" is bound and a prefix of "g g"
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 'g', &data));
+	test (CURSKEY_CHORD_MATCH,   curskey_chords_feed(chords, 'g', &data));
+	test_str ("top",             data);
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 'g', &data));
+	test (CURSKEY_CHORD_MATCH,   curskey_chords_feed(chords, ERR, &data));
+	test_str ("g",               data);
+	test (CURSKEY_CHORD_NOMATCH, curskey_chords_feed(chords, ERR, &data));
+
+	// The bound prefix "g" is reported before the key is matched again
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 'g', &data));
+	test (CURSKEY_CHORD_REPLAY,  curskey_chords_feed(chords, KEY_F(1), &data));
+	test_str ("g",               data);
+	test (CURSKEY_CHORD_MATCH,   curskey_chords_feed(chords, KEY_F(1), &data));
+	test_str ("help",            data);
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 'g', &data));
+	test (CURSKEY_CHORD_REPLAY,  curskey_chords_feed(chords, 'a', &data));
+	test (CURSKEY_CHORD_NOMATCH, curskey_chords_feed(chords, 'a', &data));
+
+	// At most CURSKEY_CHORD_KEYS_MAX keys
+	test (OK,  curskey_chords_bind(chords, "a b c d e f g h i j k l m n o p q r s t u v w x y z 0 1 2 3 4 5", "32"));
+	test (ERR, curskey_chords_bind(chords, "a b c d e f g h i j k l m n o p q r s t u v w x y z 0 1 2 3 4 5 6", "33"));
+
+	// many bindings
+	for (int i = 0; i < 2000; ++i) {
+		keys[0] = 'a' + i % 26;
+		keys[1] = KEY_F(1) + i % 63;
+		keys[2] = 'a' + i / (26 * 63);
+		curskey_chords_bind_keys(chords, keys, 3, (void*) (long) (i + 1));
+	}
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 'a' + 1234 % 26, &data));
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, KEY_F(1) + 1234 % 63, &data));
+	test (CURSKEY_CHORD_MATCH,   curskey_chords_feed(chords, 'a' + 1234 / (26 * 63), &data));
+	test (1235,                  (int) (long) data);
+	curskey_chords_free(chords);
+
+	// timeout
+	chords = curskey_chords_new(0);
+	curskey_chords_bind(chords, "C-x C-s", "save");
+	curskey_chords_bind(chords, "g", "g");
+	curskey_chords_bind(chords, "g g", "top");
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 24, &data));
+	test (0,                     curskey_chords_timeout(chords));
+	napms(5);
+	test (CURSKEY_CHORD_NOMATCH, curskey_chords_feed(chords, 19, &data));
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 'g', &data));
+	napms(5);
+	test (CURSKEY_CHORD_REPLAY,  curskey_chords_feed(chords, 'g', &data));
+	test_str ("g",               data);
+	test (CURSKEY_CHORD_PREFIX,  curskey_chords_feed(chords, 'g', &data));
+	curskey_chords_reset(chords);
+	test (-1,                    curskey_chords_timeout(chords));
+	curskey_chords_free(chords);
+#undef test
+}
+
+// Wait as long as curskey_drain() asked for, like an event loop polling
+// the input would, then drain again
+static int drain_after(int wait_ms, int *keys, int max, int *timeout) {
+	poll(NULL, 0, wait_ms);
+	return curskey_drain(keys, max, timeout);
+}
+
+void opt_decoder_tests(WINDOW *pad, int fds[2]) {
+	static const char input[] =
+		"a" "\033b" "\033[1;5A" "\033[2$" "\033[99z" "\033\033[1;5A"
+		"\033[7;5~" "\033[3;8~" "\033O3Q" "\033[24@" "\033[c" "\033Ob" "\033[1;9A" "\033[;2H"
+		"\033";
+
+#define test test_int
+	// ========================================================================
+	// CURSKEY_OPT_DECODER ====================================================
+	// ========================================================================
+
+	test ((int) sizeof(input) - 1,      (int) write(fds[1], input, sizeof(input) - 1));
+
+	test ('a',                          curskey_wgetch(pad));
+	test (curskey_parse("M-b"),         curskey_wgetch(pad));
+	test ((KEY_UP|CTRL),                curskey_wgetch(pad));
+	test ((KEY_IC|SHIFT),               curskey_wgetch(pad));
+	test ((KEY_UP|CTRL|META),           curskey_wgetch(pad));
+	test ((KEY_HOME|CTRL),              curskey_wgetch(pad));
+	test ((KEY_DC|CTRL|META|SHIFT),     curskey_wgetch(pad));
+	test ((KEY_F(2)|META),              curskey_wgetch(pad));
+	test ((KEY_F(12)|CTRL|SHIFT),       curskey_wgetch(pad));
+	test ((KEY_RIGHT|SHIFT),            curskey_wgetch(pad));
+	test ((KEY_DOWN|CTRL),              curskey_wgetch(pad));
+	test (curskey_ext_key(KEY_UP, CURSKEY_MOD_SUPER), curskey_wgetch(pad));
+	test ((KEY_HOME|SHIFT),             curskey_wgetch(pad));
+	test (KEY_ESCAPE,                   curskey_wgetch(pad));
+	test (ERR,                          curskey_wgetch(pad));
+	test (0,                            wgetdelay(pad));
+	test (ERR,                          curskey_enable(1 << 30));
+
+	// Carriage return is KEY_RETURN, whether in nl() or nonl() mode
+	test (5,                            (int) write(fds[1], "\r\033\r\n\r", 5));
+	test (KEY_RETURN,                   curskey_wgetch(pad));
+	test (curskey_parse("M-RETURN"),    curskey_wgetch(pad));
+	test ('\n',                         curskey_wgetch(pad));
+	KEY_RETURN = '\r';
+	test ('\r',                         curskey_wgetch(pad));
+	test (curskey_parse("RETURN"),      '\r');
+	KEY_RETURN = '\n';
+
+	// The reports of options that are not enabled are skipped
+	test (48,                           (int) write(fds[1], "\033[200~" "\033[<0;1;1M" "\033[I"
+		"\033[48;40;120t" "\033[97;5u" "\033[27;5;49~" "z", 48));
+	test ('z',                          curskey_wgetch(pad));
+	test (ERR,                          curskey_wgetch(pad));
+#undef test
+}
+
+void batch_tests(WINDOW *pad, int fds[2]) {
+	static const char batch[] = "abc" "\033[1;5A" "def" "\033b" "\033[";
+	int keys[8];
+
+#define test test_int
+	// ========================================================================
+	// curskey_wgetch_batch() =================================================
+	// ========================================================================
+
+	test ((int) sizeof(batch) - 1,      (int) write(fds[1], batch, sizeof(batch) - 1));
+	test (2,                            curskey_wgetch_batch(pad, keys, 2));
+	test ('b',                          keys[1]);
+	test (6,                            curskey_wgetch_batch(pad, keys, 8));
+	test ('c',                          keys[0]);
+	test ((KEY_UP|CTRL),                keys[1]);
+	test ('f',                          keys[4]);
+	test (curskey_parse("M-b"),         keys[5]);
+	test (1,                            curskey_wgetch_batch(pad, keys, 8));
+	test (curskey_parse("M-["),         keys[0]);
+	test (ERR,                          curskey_wgetch_batch(pad, keys, 8));
+#undef test
+}
+
+void repeat_tests(WINDOW *pad, int fds[2]) {
+	int n;
+
+#define test test_int
+	// ========================================================================
+	// curskey_wgetch_repeat() ================================================
+	// ========================================================================
+
+	test (13,                           (int) write(fds[1], "jjjk\033[A\033[A\033[A", 13));
+	test ('j',                          curskey_wgetch_repeat(pad, &n));
+	test (3,                            n);
+	test ('k',                          curskey_wgetch_repeat(pad, &n));
+	test (1,                            n);
+	test (KEY_UP,                       curskey_wgetch_repeat(pad, &n));
+	test (3,                            n);
+	test (ERR,                          curskey_wgetch_repeat(pad, &n));
+#undef test
+}
+
+void utf8_tests(WINDOW *pad, int fds[2]) {
+#define test test_int
+	// ========================================================================
+	// curskey_wget_wch(), CURSKEY_OPT_UTF8 ===================================
+	// ========================================================================
+
+	test (7,                            (int) write(fds[1], "\xc3\xa4\033\xc3\xa9z\xff", 7));
+	test (curskey_ext_char(0xE4, 0),    curskey_wget_wch(pad));
+	test (curskey_ext_char(0xE9, META), curskey_wget_wch(pad));
+	test ('z',                          curskey_wget_wch(pad));
+	test (0xFF,                         curskey_wget_wch(pad));
+	test (ERR,                          curskey_wget_wch(pad));
+	test (3,                            (int) write(fds[1], "\xc3\xa4" "a", 3));
+	test (0xC3,                         curskey_wgetch(pad));
+	test (0xA4,                         curskey_wgetch(pad));
+	test ('a',                          curskey_wgetch(pad));
+	test (OK,                           curskey_enable(CURSKEY_OPT_UTF8));
+	test (3,                            (int) write(fds[1], "\xe2\x82\xac", 3));
+	test (curskey_ext_char(0x20AC, 0),  curskey_wgetch(pad));
+	test (OK,                           curskey_disable(CURSKEY_OPT_UTF8));
+	test (curskey_ext_char(0xE4, 0),    curskey_parse("\xc3\xa4"));
+	test (curskey_ext_char(0xE4, META), curskey_parse("M-\xc3\xa4"));
+	test (curskey_ext_char(0x20AC, CTRL|META), curskey_parse("C-M-\xe2\x82\xac"));
+	test (ERR,                          curskey_parse("\xc3\xa4x"));
+#undef test
+
+#define test test_str
+	test ("C-\xC3\xA4",                 curskey_get_keydef(curskey_ext_char(0xE4, CTRL)));
+	test ("M-\xC3\xA4",                 curskey_get_keydef(curskey_parse("M-\xc3\xa4")));
+#undef test
+}
+
+void paste_tests(WINDOW *pad, int fds[2]) {
+	static const char paste[] = "x\033[200~hello\nworld\033[201~ab\033[200~\033[201~y";
+	static char big[20000];
+	int keys[8], wait_ms, i;
+	size_t len;
+
+#define test test_int
+	// ========================================================================
+	// CURSKEY_OPT_PASTE ======================================================
+	// ========================================================================
+
+	test (OK,                           curskey_enable(CURSKEY_OPT_PASTE));
+	test ((int) sizeof(paste) - 1,      (int) write(fds[1], paste, sizeof(paste) - 1));
+	test ('x',                          curskey_wgetch(pad));
+	test (KEY_PASTE,                    curskey_wgetch(pad));
+	test (11,                           (int) strlen(curskey_paste(NULL)));
+	test (1,                            streq("hello\nworld", curskey_paste(NULL)));
+	test (3,                            curskey_wgetch_batch(pad, keys, 8));
+	test (KEY_PASTE,                    keys[2]);
+	test (1,                            streq("", curskey_paste(NULL)));
+	test ('y',                          curskey_wgetch(pad));
+
+	memset(big, 'p', sizeof(big));
+	test (6,                            (int) write(fds[1], "\033[200~", 6));
+	test ((int) sizeof(big),            (int) write(fds[1], big, sizeof(big)));
+	test (7,                            (int) write(fds[1], "\033[201~z", 7));
+	test (KEY_PASTE,                    curskey_wgetch(pad));
+	test ((int) sizeof(big),            (int) (curskey_paste(&len), len));
+	test ('z',                          curskey_wgetch(pad));
+	test (KEY_PASTE,                    curskey_parse("PASTE"));
+
+	// A window without delay does not wait for the end of the paste
+	test (8,                            (int) write(fds[1], "\033[200~ab", 8));
+	test (ERR,                          curskey_wgetch(pad));
+	test (8,                            (int) write(fds[1], "c\033[201~z", 8));
+	test (KEY_PASTE,                    curskey_wgetch(pad));
+	test (1,                            streq("abc", curskey_paste(NULL)));
+	test ('z',                          curskey_wgetch(pad));
+
+	// More input after the end of the paste than the read-ahead buffer holds
+	memset(big, 'q', 6000);
+	memcpy(big, "\033[201~", 6);
+	test (8,                            (int) write(fds[1], "\033[200~ab", 8));
+	test (ERR,                          curskey_wgetch(pad));
+	test (6000,                         (int) write(fds[1], big, 6000));
+	test (KEY_PASTE,                    curskey_wgetch(pad));
+	test (1,                            streq("ab", curskey_paste(NULL)));
+	for (i = 0; curskey_wgetch(pad) == 'q'; ++i)
+		;
+	test (6000 - 6,                     i);
+	memset(big, 'p', sizeof(big));
+
+	// Text beyond CURSKEY_PASTE_MAX is dropped, the end is still found
+	test (6,                            curskey_feed("\033[200~", 6));
+	for (i = 0; i <= CURSKEY_PASTE_MAX / 4000; ++i) {
+		curskey_feed(big, 4000);
+		curskey_drain(keys, 8, &wait_ms);
+	}
+	test (4,                            curskey_feed("\033[20", 4));
+	test (0,                            curskey_drain(keys, 8, &wait_ms));
+	test (3,                            curskey_feed("1~z", 3));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test (KEY_PASTE,                    keys[0]);
+	test (CURSKEY_PASTE_MAX,            (int) (curskey_paste(&len), len));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test ('z',                          keys[0]);
+	test (OK,                           curskey_disable(CURSKEY_OPT_PASTE));
+#undef test
+}
+
+void kitty_tests(WINDOW *pad, int fds[2]) {
+	static const char kitty[] = "\033[9;5u" "\033[97;6u" "\033[97;3u" "\033[13;2u" "\033[27u"
+		"\033[57399u" "\033[228:196;5u" "\033[57419;5u" "\033[127;1:1u";
+
+#define test test_int
+	// ========================================================================
+	// CURSKEY_OPT_KITTY ======================================================
+	// ========================================================================
+
+	test (1,                            curskey_ext_key('a', CTRL));
+	test ((KEY_UP|CTRL),                curskey_ext_key(KEY_UP, CTRL));
+	test ('A',                          curskey_ext_key('a', SHIFT));
+	test ((CURSKEY_EXT|(CTRL<<12)|'\t'), curskey_ext_key('\t', CTRL));
+	test (curskey_ext_char('a', CTRL|SHIFT), curskey_ext_key('A', CTRL));
+	test ('\t',                         curskey_unmod_key(curskey_ext_key('\t', CTRL), NULL));
+	test (KEY_UP,                       curskey_unmod_key(curskey_ext_key(KEY_UP, CURSKEY_MOD_SUPER), NULL));
+	test (ERR,                          curskey_ext_key(KEY_UP, 1 << 20));
+	test (ERR,                          curskey_parse("C-TAB"));
+	test (OK,                           curskey_enable(CURSKEY_OPT_KITTY));
+	test (curskey_ext_key('\t', CTRL),  curskey_parse("C-TAB"));
+	test (curskey_ext_key('a', CTRL|SHIFT), curskey_parse("C-S-a"));
+	test (curskey_ext_key(KEY_UP, CURSKEY_MOD_SUPER|CURSKEY_MOD_HYPER), curskey_parse("super-Hyper-UP"));
+	test (1,                            curskey_parse("C-a"));
+	test ((int) sizeof(kitty) - 1,      (int) write(fds[1], kitty, sizeof(kitty) - 1));
+	test (curskey_parse("C-TAB"),       curskey_wgetch(pad));
+	test (curskey_parse("C-S-a"),       curskey_wgetch(pad));
+	test (curskey_parse("M-a"),         curskey_wgetch(pad));
+	test (curskey_parse("S-RETURN"),    curskey_wgetch(pad));
+	test (KEY_ESCAPE,                   curskey_wgetch(pad));
+	test ('0',                          curskey_wgetch(pad));
+	test (curskey_ext_char(0xE4, CTRL), curskey_wgetch(pad));
+	test ((KEY_UP|CTRL),                curskey_wgetch(pad));
+	test (KEY_BACKSPACE,                curskey_wgetch(pad));
+	test (OK,                           curskey_disable(CURSKEY_OPT_KITTY));
+	test (ERR,                          curskey_parse("C-TAB"));
+#undef test
+
+#define test test_str
+	test ("C-TAB",                      curskey_get_keydef(curskey_ext_key('\t', CTRL)));
+	test ("S-C-a",                      curskey_get_keydef(curskey_ext_key('a', CTRL|SHIFT)));
+	test ("M-Super-UP",                 curskey_get_keydef(curskey_ext_key(KEY_UP, META|CURSKEY_MOD_SUPER)));
+#undef test
+}
+
+void modify_other_keys_tests(WINDOW *pad, int fds[2]) {
+	static const char other[] = "\033[27;5;49~" "\033[27;6;65~" "\033[27;7;13~" "\033[27;5;9~"
+		"\033[27;5;97~" "\033[27;5~";
+
+#define test test_int
+	// ========================================================================
+	// CURSKEY_OPT_MODIFY_OTHER_KEYS ==========================================
+	// ========================================================================
+
+	test (ERR,                          curskey_parse("C-1"));
+	test (OK,                           curskey_enable(CURSKEY_OPT_MODIFY_OTHER_KEYS));
+	test (curskey_ext_key('1', CTRL),   curskey_parse("C-1"));
+	test ((int) sizeof(other) - 1,      (int) write(fds[1], other, sizeof(other) - 1));
+	test (curskey_parse("C-1"),         curskey_wgetch(pad));
+	test (curskey_parse("C-S-a"),       curskey_wgetch(pad));
+	test (curskey_parse("M-C-RETURN"),  curskey_wgetch(pad));
+	test (curskey_parse("C-TAB"),       curskey_wgetch(pad));
+	test (1,                            curskey_wgetch(pad));
+	test (ERR,                          curskey_wgetch(pad));
+	test (OK,                           curskey_disable(CURSKEY_OPT_MODIFY_OTHER_KEYS));
+	test (ERR,                          curskey_parse("C-1"));
+#undef test
+}
+
+void escdelay_tests(int fds[2]) {
+	int keys[8], wait_ms, i;
+
+#define test test_int
+	// ========================================================================
+	// CURSKEY_OPT_ADAPTIVE_ESCDELAY ==========================================
+	// ========================================================================
+
+	test (10,                           curskey_escdelay());
+	test (OK,                           curskey_enable(CURSKEY_OPT_ADAPTIVE_ESCDELAY));
+	test (CURSKEY_ESCDELAY_INITIAL,     curskey_escdelay());
+	test (OK,                           curskey_set_input_fd(fds[0]));
+
+	// The ESC of a sequence timed out, the rest came later: wait longer
+	test (1,                            curskey_feed("\033", 1));
+	test (0,                            curskey_drain(keys, 8, &wait_ms));
+	test (CURSKEY_ESCDELAY_INITIAL,     wait_ms);
+	test (1,                            drain_after(wait_ms, keys, 8, &wait_ms));
+	test (KEY_ESCAPE,                   keys[0]);
+	test (5,                            curskey_feed("[1;5A", 5));
+	test (5,                            curskey_drain(keys, 8, &wait_ms));
+	test (1,                            curskey_escdelay() > CURSKEY_ESCDELAY_INITIAL);
+
+	// Sequences that arrive in one piece: wait shorter, down to the minimum
+	test (3,                            curskey_feed("\033[A", 3));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test (KEY_UP,                       keys[0]);
+	for (i = 0; i < 100 && curskey_escdelay() > CURSKEY_ESCDELAY_MIN; ++i) {
+		curskey_feed("\033OB", 3);
+		curskey_drain(keys, 8, &wait_ms);
+	}
+	test (CURSKEY_ESCDELAY_MIN,         curskey_escdelay());
+
+	test (OK,                           curskey_set_input_fd(STDIN_FILENO));
+	test (OK,                           curskey_disable(CURSKEY_OPT_ADAPTIVE_ESCDELAY));
+#undef test
+}
+
+void drain_tests(int fds[2]) {
+	int keys[8], wait_ms;
+
+#define test test_int
+	// ========================================================================
+	// curskey_fill(), curskey_feed(), curskey_drain() ========================
+	// ========================================================================
+
+	test (STDIN_FILENO,                 curskey_input_fd());
+	test (OK,                           curskey_set_input_fd(fds[0]));
+	test (fds[0],                       curskey_input_fd());
+	test (0,                            curskey_fill());
+	test (0,                            curskey_drain(keys, 8, &wait_ms));
+	test (-1,                           wait_ms);
+	test (6,                            curskey_feed("a\033[1;5", 6));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test ('a',                          keys[0]);
+	test (1,                            wait_ms > 0 && wait_ms <= 10);
+	test (1,                            curskey_feed("A", 1));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test ((KEY_UP|CTRL),                keys[0]);
+	test (-1,                           wait_ms);
+	test (1,                            curskey_feed("\033", 1));
+	test (0,                            curskey_drain(keys, 8, &wait_ms));
+	test (1,                            drain_after(wait_ms, keys, 8, &wait_ms));
+	test (KEY_ESCAPE,                   keys[0]);
+	test (3,                            (int) write(fds[1], "xyz", 3));
+	test (3,                            curskey_fill());
+	test (2,                            curskey_drain(keys, 2, &wait_ms));
+	test ('y',                          keys[1]);
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test ('z',                          keys[0]);
+	test (OK,                           curskey_enable(CURSKEY_OPT_PASTE));
+	test (9,                            curskey_feed("\033[200~abc", 9));
+	test (0,                            curskey_drain(keys, 8, &wait_ms));
+	test (1,                            wait_ms > 0);
+	test (10,                           curskey_feed("def\033[201~z", 10));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test (KEY_PASTE,                    keys[0]);
+	test (1,                            streq("abcdef", curskey_paste(NULL)));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test ('z',                          keys[0]);
+	test (OK,                           curskey_disable(CURSKEY_OPT_PASTE));
+	test (OK,                           curskey_set_input_fd(STDIN_FILENO));
+#undef test
+}
+
+void mouse_tests(void) {
+	int keys[8], wait_ms;
+
+#define test test_int
+	// ========================================================================
+	// CURSKEY_OPT_MOUSE ======================================================
+	// ========================================================================
+
+	test (OK,                           curskey_enable(CURSKEY_OPT_MOUSE));
+	test (31,                           curskey_feed("\033[<0;10;5M\033[<34;11;6M\033[<16;1;1m", 31));
+	test (3,                            curskey_drain(keys, 8, &wait_ms));
+	test (1,                            curskey_is_mouse(keys[0]));
+	test (curskey_mouse(1, CURSKEY_MOUSE_PRESS, 9, 4, 0), keys[0]);
+	test (9,                            curskey_mouse_x(keys[0]));
+	test (4,                            curskey_mouse_y(keys[0]));
+	test (1,                            curskey_mouse_button(keys[0]));
+	test (CURSKEY_MOUSE_MOTION,         curskey_mouse_action(keys[1]));
+	test (3,                            curskey_mouse_button(keys[1]));
+	test (10,                           curskey_mouse_x(keys[1]));
+	test (CURSKEY_MOUSE_RELEASE,        curskey_mouse_action(keys[2]));
+	test (CTRL,                         curskey_mouse_mods(keys[2]));
+	test (0,                            keys[2] & CURSKEY_EXT);
+	test (0,                            curskey_mouse_x(keys[2]));
+	test (10,                           curskey_feed("\033[<28;1;1M", 10));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test ((SHIFT|META|CTRL),            curskey_mouse_mods(keys[0]));
+	test (0,                            keys[0] & CURSKEY_EXT);
+	test (curskey_mouse(1, CURSKEY_MOUSE_PRESS, 0, 0, SHIFT|META|CTRL), keys[0]);
+	test (31,                           curskey_feed("\033[<65;2000;3M\033[<35;4;4M\033[<1;2Mq", 31));
+	test (3,                            curskey_drain(keys, 8, &wait_ms));
+	test (curskey_mouse(5, CURSKEY_MOUSE_PRESS, CURSKEY_MOUSE_POS_MAX, 2, 0), keys[0]);
+	test (curskey_mouse(0, CURSKEY_MOUSE_MOTION, 3, 3, 0), keys[1]);
+	test ('q',                          keys[2]);
+	test (0,                            curskey_is_mouse(keys[2]));
+	test (0,                            curskey_is_mouse(ERR));
+	test (OK,                           curskey_disable(CURSKEY_OPT_MOUSE));
+	test (1,                            curskey_get_keydef(keys[0]) == NULL);
+#undef test
+}
+
+void focus_resize_tests(void) {
+	int keys[8], wait_ms, rows, cols;
+
+#define test test_int
+	// ========================================================================
+	// CURSKEY_OPT_FOCUS, CURSKEY_OPT_RESIZE ==================================
+	// ========================================================================
+
+	test (OK,                           curskey_enable(CURSKEY_OPT_FOCUS|CURSKEY_OPT_RESIZE));
+	test (6,                            curskey_feed("\033[O\033[I", 6));
+	test (2,                            curskey_drain(keys, 8, &wait_ms));
+	test (KEY_FOCUS_OUT,                keys[0]);
+	test (KEY_FOCUS_IN,                 keys[1]);
+	test (KEY_FOCUS_IN,                 curskey_parse("FocusIn"));
+	test (OK,                           curskey_term_size(&rows, &cols));
+	test (LINES,                        rows);
+	test (COLS,                         cols);
+	test (32,                           curskey_feed("\033[48;40;120;800;960t\033[48;40;120t", 32));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test (KEY_RESIZE,                   keys[0]);
+	test (OK,                           curskey_term_size(&rows, &cols));
+	test (40,                           rows);
+	test (120,                          cols);
+	test (8,                            curskey_feed("\033[48;1tx", 8));
+	test (1,                            curskey_drain(keys, 8, &wait_ms));
+	test ('x',                          keys[0]);
+	test (OK,                           curskey_disable(CURSKEY_OPT_FOCUS|CURSKEY_OPT_RESIZE));
+#undef test
+}
+
+void record_tests(void) {
+	unsigned char recorded[64];
+	int keys[8], rec[2], wait_ms, n, i;
+
+#define test test_int
+	// ========================================================================
+	// curskey_record() =======================================================
+	// ========================================================================
+
+	test (OK,                           pipe(rec));
+	test (OK,                           curskey_record(rec[1]));
+	test (2,                            curskey_feed("ab", 2));
+	test (OK,                           curskey_record(-1));
+	test (2,                            curskey_feed("cd", 2));
+	test (4,                            curskey_drain(keys, 8, &wait_ms));
+	n = (int) read(rec[0], recorded, sizeof(recorded));
+	test (0,                            memcmp(recorded, CURSKEY_RECORD_MAGIC, 8));
+	for (i = 8; i < n && (recorded[i] & 0x80); ++i); // Microseconds
+	test (n - 4,                        i);
+	test (2,                            recorded[n - 3]);
+	test (0,                            memcmp(recorded + n - 2, "ab", 2));
+	close(rec[0]);
+	close(rec[1]);
+#undef test
+}
+
+void latency_tests(void) {
+	struct curskey_latency stats;
+	int keys[8], wait_ms;
+
+#define test test_int
+	// ========================================================================
+	// curskey_latency() ======================================================
+	// ========================================================================
+
+	curskey_latency_reset();
+#ifdef CURSKEY_LATENCY
+	test (9,                            curskey_feed("a\033b\033[A\033OP", 9));
+	test (4,                            curskey_drain(keys, 8, &wait_ms));
+	test (OK,                           curskey_latency(-1, &stats));
+	test (4,                            stats.count);
+	test (1,                            stats.min <= stats.p50 && stats.p50 <= stats.p999);
+	test (OK,                           curskey_latency(CURSKEY_LATENCY_PLAIN, &stats));
+	test (1,                            stats.count);
+	test (OK,                           curskey_latency(CURSKEY_LATENCY_META, &stats));
+	test (1,                            stats.count);
+	test (OK,                           curskey_latency(CURSKEY_LATENCY_SEQ, &stats));
+	test (2,                            stats.count);
+	test (ERR,                          curskey_latency(CURSKEY_LATENCY_CLASSES, &stats));
+#else
+	(void) keys;
+	(void) wait_ms;
+	test (ERR,                          curskey_latency(-1, &stats));
+#endif
+#undef test
+}
+
+void thread_tests(int fds[2]) {
+	static char many[CURSKEY_THREAD_QUEUE + 100];
+	struct curskey_event events[8];
+	struct pollfd pfd;
+	int n, i;
+
+#define test test_int
+	// ========================================================================
+	// curskey_thread_start() =================================================
+	// ========================================================================
+
+#ifdef CURSKEY_THREAD
+	test (OK,                           curskey_set_input_fd(fds[0]));
+	test (OK,                           curskey_enable(CURSKEY_OPT_PASTE));
+	test (OK,                           curskey_thread_start());
+	test (ERR,                          curskey_thread_start());
+	test (0,                            curskey_thread_drain(events, 8));
+	pfd.fd = curskey_thread_fd();
+	pfd.events = POLLIN;
+	test (18,                           (int) write(fds[1], "a\033[A\033[200~hi\033[201~", 18));
+	for (n = 0; n < 3 && poll(&pfd, 1, 1000) == 1; )
+		n += curskey_thread_drain(events + n, 8 - n);
+	test (3,                            n);
+	test ('a',                          events[0].key);
+	test (KEY_UP,                       events[1].key);
+	test (KEY_PASTE,                    events[2].key);
+	test (1,                            streq("hi", events[2].paste));
+	test (2,                            (int) events[2].paste_len);
+	test (1,                            events[0].time <= events[2].time);
+	free(events[2].paste);
+
+	// More keys than the queue holds, the thread waits for room
+	memset(many, 'k', sizeof(many));
+	test ((int) sizeof(many),           (int) write(fds[1], many, sizeof(many)));
+	for (n = 0; n < (int) sizeof(many) && poll(&pfd, 1, 1000) == 1; )
+		while ((i = curskey_thread_drain(events, 8)) > 0)
+			n += i;
+	test ((int) sizeof(many),           n);
+	test ('k',                          events[0].key);
+	test (OK,                           curskey_thread_stop());
+	test (ERR,                          curskey_thread_stop());
+	test (OK,                           curskey_disable(CURSKEY_OPT_PASTE));
+#else
+	(void) fds;
+	(void) many;
+	(void) pfd;
+	(void) n;
+	(void) i;
+	test (ERR,                          curskey_thread_start());
+	test (0,                            curskey_thread_drain(events, 8));
+#endif
+	test (-1,                           curskey_thread_fd());
+	test (OK,                           curskey_set_input_fd(STDIN_FILENO));
+#undef test
+}
+
+void wget_wch_tests(WINDOW *pad) {
+#define test test_int
+	// ========================================================================
+	// curskey_wget_wch() without CURSKEY_OPT_DECODER =========================
+	// ========================================================================
+
+	// ungetch() returns the last first
+#if defined(NCURSES_WIDECHAR) && NCURSES_WIDECHAR
+	setlocale(LC_CTYPE, "C.UTF-8"); // wget_wch() decodes by the locale
+#endif
+	ungetch('x');
+	ungetch(0xA4);
+	ungetch(0xC3);
+	ungetch(KEY_ESCAPE);
+	test (curskey_ext_char(0xE4, META), curskey_wget_wch(pad));
+	test ('x',                          curskey_wget_wch(pad));
+
+#if ! (defined(NCURSES_WIDECHAR) && NCURSES_WIDECHAR)
+	// Bytes that are not UTF-8 are returned one by one, to either function
+	ungetch('b');
+	ungetch('a');
+	ungetch(0xA4);
+	ungetch(0xC3);
+	ungetch(0xE2);
+	test (0xE2,                         curskey_wget_wch(pad));
+	test (0xC3,                         curskey_wgetch(pad));
+	test (0xA4,                         curskey_wgetch(pad));
+	test ('a',                          curskey_wget_wch(pad));
+	test ('b',                          curskey_wgetch(pad));
+#endif
+#undef test
+}
+
+void repeat_raw_tests(WINDOW *pad) {
+	int n;
+
+#define test test_int
+	// ========================================================================
+	// curskey_wgetch_repeat() without CURSKEY_OPT_DECODER ====================
+	// ========================================================================
+
+	// ungetch() returns the last first
+	ungetch('b');
+	ungetch('a');
+	ungetch(KEY_ESCAPE);
+	ungetch('a');
+	ungetch(KEY_ESCAPE);
+	ungetch('a');
+	ungetch('a');
+	test ('a',                          curskey_wgetch_repeat(pad, &n));
+	test (2,                            n);
+	test (curskey_parse("M-a"),         curskey_wgetch_repeat(pad, &n));
+	test (1,                            n);
+	test (curskey_parse("M-a"),         curskey_wgetch_repeat(pad, &n));
+	test (1,                            n);
+	test ('b',                          curskey_wgetch_repeat(pad, &n));
+	test (1,                            n);
+	test (ERR,                          curskey_wgetch_repeat(pad, &n));
+#undef test
+}
+
+void decoder_tests() {
+	int fds[2], saved_stdin = dup(STDIN_FILENO);
+	WINDOW *pad = newpad(1, 1);
+
+	if (pipe(fds) != 0)
+		return;
+	dup2(fds[0], STDIN_FILENO);
+	set_escdelay(10);
+	wtimeout(pad, 0);
+	curskey_enable(CURSKEY_OPT_DECODER);
+
+	opt_decoder_tests(pad, fds);
+	batch_tests(pad, fds);
+	repeat_tests(pad, fds);
+	utf8_tests(pad, fds);
+	paste_tests(pad, fds);
+	kitty_tests(pad, fds);
+	modify_other_keys_tests(pad, fds);
+	escdelay_tests(fds);
+	drain_tests(fds);
+	mouse_tests();
+	focus_resize_tests();
+	record_tests();
+	latency_tests();
+	thread_tests(fds);
+
+	curskey_disable(CURSKEY_OPT_DECODER);
+	wget_wch_tests(pad);
+	repeat_raw_tests(pad);
+
+	dup2(saved_stdin, STDIN_FILENO);
+	close(saved_stdin);
+	close(fds[0]);
+	close(fds[1]);
+	delwin(pad);
+}
+
+void headless_tests() {
+	static const unsigned char input[] =
+		"a" "\033b" "\033[1;5A" "\033[2$" "\033[99z" "\033\033[1;5A" "\033[[B" "\033OM"
+		"\177" "\033[97;6u" "\033[27;5;9~" "\033[200~\033[A\033[201" "~" "\033[1;5";
+	struct curskey_decoder state = { { 0 }, 0, 0, 0 };
+	int keys[64], split[64];
+	int n, i, total = 0;
+
+#define test test_int
+	// ========================================================================
+	// curskey_decode() =======================================================
+	// ========================================================================
+
+	n = curskey_decode(input, sizeof(input) - 1, &state, keys);
+	test (15,                           n);
+	test ('a',                          keys[0]);
+	test (curskey_parse("M-b"),         keys[1]);
+	test ((KEY_UP|CTRL),                keys[2]);
+	test ((KEY_IC|SHIFT),               keys[3]);
+	test ((KEY_UP|CTRL|META),           keys[4]);
+	test (KEY_F(2),                     keys[5]);
+	test (KEY_ENTER,                    keys[6]);
+	test (KEY_BACKSPACE,                keys[7]);
+	test (curskey_ext_key('a', CTRL|SHIFT), keys[8]);
+	test (curskey_ext_key('\t', CTRL),  keys[9]);
+	test (KEY_PASTE,                    keys[10]);
+	test (KEY_ESCAPE,                   keys[11]);
+	test ('[',                          keys[12]);
+	test ('A',                          keys[13]);
+	test (KEY_PASTE,                    keys[14]);
+	test (5,                            state.len);
+
+	// Byte by byte
+	memset(&state, 0, sizeof(state));
+	for (i = 0; i < (int) sizeof(input) - 1; ++i)
+		total += curskey_decode(input + i, 1, &state, split + total);
+	test (n,                            total);
+	test (0,                            memcmp(keys, split, sizeof(*keys) * n));
+
+	test (0,                            curskey_decode((const unsigned char*) "", 0, &state, keys));
+	test (1,                            curskey_decode((const unsigned char*) "D", 1, &state, keys));
+	test ((KEY_LEFT|CTRL),              keys[0]);
+	test (0,                            state.len);
+	test (0,                            curskey_decode((const unsigned char*) "\033[", 2, &state, keys));
+	test (1,                            curskey_decode_flush(&state, keys));
+	test (curskey_parse("M-["),         keys[0]);
+	test (0,                            curskey_decode_flush(&state, keys));
+	test (2,                            curskey_decode((const unsigned char*) "\r\n", 2, &state, keys));
+	test ('\n',                         keys[0]);
+	test ('\n',                         keys[1]);
+
+	// The Return key of the decoder, not KEY_RETURN
+	curskey_decoder_init(&state, '\r');
+	KEY_RETURN = KEY_ENTER;
+	test (2,                            curskey_decode((const unsigned char*) "\r\033\r", 3, &state, keys));
+	test ('\r',                         keys[0]);
+	test (curskey_mod_key('\r', META), keys[1]);
+	KEY_RETURN = '\n';
+#undef test
+}
+
+void ctx_tests() {
+	struct curskey_ctx *a = curskey_ctx_new();
+	struct curskey_ctx *b = curskey_ctx_new();
+	int keys[8], wait_ms;
+
+	if (! a || ! b)
+		return;
+
+#define test test_int
+	// ========================================================================
+	// curskey_ctx ============================================================
+	// ========================================================================
+
+	curskey_ctx_set_return(b, '\r');
+	test ('\n',                         curskey_parse_ctx(a, "RETURN"));
+	test ('\r',                         curskey_parse_ctx(b, "RETURN"));
+	test ('\n',                         curskey_parse("RETURN"));
+	test (curskey_parse("C-M"),         curskey_parse_ctx(a, "C-M"));
+	test (OK,                           curskey_enable_ctx(a, CURSKEY_OPT_DECODER));
+	test (OK,                           curskey_enable_ctx(b, CURSKEY_OPT_DECODER));
+	test (3,                            curskey_feed_ctx(a, "\033[A", 3));
+	test (1,                            curskey_feed_ctx(b, "\r", 1));
+	test (0,                            curskey_drain(keys, 8, &wait_ms));
+	test (1,                            curskey_drain_ctx(b, keys, 8, &wait_ms));
+	test ('\r',                         keys[0]);
+	test (1,                            curskey_drain_ctx(a, keys, 8, &wait_ms));
+	test (KEY_UP,                       keys[0]);
+	test (OK,                           curskey_disable_ctx(a, CURSKEY_OPT_DECODER));
+	test (OK,                           curskey_disable_ctx(b, CURSKEY_OPT_DECODER));
+	test (1,                            curskey_ctx_default() != a);
+
+	FILE *out = tmpfile();
+	char modes[64] = { 0 };
+	if (out) {
+		curskey_set_output_ctx(b, out);
+		test (OK,                           curskey_enable_ctx(b, CURSKEY_OPT_FOCUS));
+		test (OK,                           curskey_disable_ctx(b, CURSKEY_OPT_FOCUS));
+		curskey_set_output_ctx(b, NULL);
+		rewind(out);
+		test (1,                            fread(modes, 1, sizeof(modes) - 1, out) > 0);
+		test (1,                            strstr(modes, "\033[?1004h") != NULL);
+		test (1,                            strstr(modes, "\033[?1004l") != NULL);
+		fclose(out);
+	}
+#undef test
+
+#define test test_str
+	test ("RETURN",                     curskey_get_keydef_ctx(b, '\r'));
+	test (curskey_get_keydef('\r'),     curskey_get_keydef_ctx(a, '\r'));
+	test ("100",                        curses_color_tostring_ctx(a, 100));
+	test ("200",                        curses_color_tostring_ctx(b, 200));
+	test ("100",                        curses_color_tostring_ctx(a, 100));
+#undef test
+
+	curskey_ctx_free(a);
+	curskey_ctx_free(b);
 }
 
 void print_keys() {
@@ -331,6 +1351,11 @@ int main(int argc, char *argv[])
     if (opt_dump)
         print_keys();
     do_tests();
+    keymap_tests();
+    chord_tests();
+    decoder_tests();
+    headless_tests();
+    ctx_tests();
 
 	if (opt_interactive) {
 		noecho();
@@ -0,0 +1,63 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../curskey.h"
+
+// Compares the per-binding cost of curskey_parse() in a loop against
+// curskey_parse_many() and curskey_parse_lines() on a generated keymap.
+
+#define BINDINGS 2000
+#define ROUNDS   200
+
+static const char *keymap_defs[] = {
+	"a", "C-x", "M-x", "C-M-x", "^x", "A-RETURN", "S-HOME", "C-LEFT",
+	"F1", "F12", "KEY_F(5)", "PAGEDOWN", "KEY_BTAB", "SRIGHT", "DELETE",
+	"M-SPACE", "C-SPACE", "ESCAPE", "TAB", "BACKSPACE", "KEY_UNDO",
+};
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main() {
+	static const char *defs[BINDINGS];
+	static char text[BINDINGS * 16];
+	static int keycodes[BINDINGS];
+	static int errors[BINDINGS];
+	size_t text_len = 0;
+	volatile int sum = 0; // Keeps the loops from being optimized away
+	int round, i;
+	double start;
+
+	for (i = 0; i < BINDINGS; ++i) {
+		defs[i] = keymap_defs[i % (sizeof(keymap_defs) / sizeof(*keymap_defs))];
+		text_len += sprintf(text + text_len, "%s\n", defs[i]);
+	}
+
+	start = now();
+	for (round = 0; round < ROUNDS; ++round)
+		for (i = 0; i < BINDINGS; ++i)
+			sum += curskey_parse(defs[i]);
+	printf("curskey_parse() loop: %6.1f ns/binding\n",
+		(now() - start) / (ROUNDS * BINDINGS));
+
+	start = now();
+	for (round = 0; round < ROUNDS; ++round)
+		sum += curskey_parse_many(defs, BINDINGS, keycodes, errors);
+	printf("curskey_parse_many(): %6.1f ns/binding\n",
+		(now() - start) / (ROUNDS * BINDINGS));
+
+	start = now();
+	for (round = 0; round < ROUNDS; ++round)
+		sum += curskey_parse_lines(text, text_len, keycodes, errors, BINDINGS);
+	printf("curskey_parse_lines(): %5.1f ns/binding\n",
+		(now() - start) / (ROUNDS * BINDINGS));
+
+	return 0;
+}
+
+/* vim: set ts=4 sw=4 : */
@@ -0,0 +1,255 @@
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "../curskey.h"
+
+// Replays a recording of curskey_record() through the decoder and reports
+// the decode throughput and the latency from the arrival of the bytes
+// until their keys are returned.
+//
+//   -m  Maximum speed, ignore the recorded timing
+//   -p  Through a pty with curskey_fill()/curskey_drain() instead of
+//       the headless curskey_decode()
+//   -a  Enable CURSKEY_OPT_ADAPTIVE_ESCDELAY (with -p)
+//   -e  ESC delay in milliseconds, default 50
+
+struct record {
+	long delay_us;
+	size_t len;
+	const unsigned char *bytes;
+};
+
+static int opt_max_speed = 0;
+static int opt_pty = 0;
+static int opt_adaptive = 0;
+static int opt_escdelay = 50;
+
+static long keys_total = 0;
+static double latency_sum = 0, latency_max = 0;
+
+static double now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void sleep_until(double t) {
+	double left;
+	while ((left = t - now_us()) > 0) {
+		struct timespec ts = { (time_t) (left / 1e6), (long) ((long) left % 1000000) * 1000 };
+		nanosleep(&ts, NULL);
+	}
+}
+
+static void count_keys(int n, double since) {
+	const double latency = now_us() - since;
+	keys_total += n;
+	latency_sum += n * latency;
+	if (n && latency > latency_max)
+		latency_max = latency;
+}
+
+static const unsigned char* read_varint(const unsigned char *s, const unsigned char *end, unsigned long *value) {
+	int shift = 0;
+	*value = 0;
+	for (; s < end && shift < 64; shift += 7) {
+		*value |= (unsigned long) (*s & 0x7F) << shift;
+		if (! (*s++ & 0x80))
+			return s;
+	}
+	return NULL;
+}
+
+/// Split the recording into records, return their number or -1 if invalid
+static int parse_recording(const unsigned char *buf, size_t len, struct record **records) {
+	const size_t magic_len = sizeof(CURSKEY_RECORD_MAGIC) - 1;
+	const unsigned char *s = buf + magic_len, *end = buf + len;
+	int count = 0, size = 0;
+
+	if (len < magic_len || memcmp(buf, CURSKEY_RECORD_MAGIC, magic_len))
+		return -1;
+
+	while (s < end) {
+		unsigned long delay, n;
+		if (! (s = read_varint(s, end, &delay)) || ! (s = read_varint(s, end, &n))
+				|| n > (size_t) (end - s))
+			return -1;
+		if (count == size) {
+			size = (size ? size * 2 : 256);
+			*records = (struct record*) realloc(*records, size * sizeof(**records));
+			if (! *records)
+				return -1;
+		}
+		(*records)[count].delay_us = (long) delay;
+		(*records)[count].len = n;
+		(*records)[count].bytes = s;
+		++count;
+		s += n;
+	}
+
+	return count;
+}
+
+static void replay_headless(const struct record *records, int count) {
+	struct curskey_decoder state;
+	static int keys[CURSKEY_INPUT_BUFSIZE + CURSKEY_DECODER_PENDING];
+	double t = now_us(), arrived = t;
+
+	memset(&state, 0, sizeof(state));
+
+	for (int i = 0; i < count; ++i) {
+		const struct record *r = &records[i];
+
+		t += r->delay_us;
+		if (! opt_max_speed) {
+			// A pending ESC is taken as it is when the ESC delay expires
+			if (state.len && r->delay_us > opt_escdelay * 1000L) {
+				sleep_until(arrived + opt_escdelay * 1000L);
+				count_keys(curskey_decode_flush(&state, keys), arrived);
+			}
+			sleep_until(t);
+		}
+
+		arrived = now_us();
+		for (size_t off = 0; off < r->len; off += CURSKEY_INPUT_BUFSIZE) {
+			const size_t n = (r->len - off < CURSKEY_INPUT_BUFSIZE ? r->len - off : CURSKEY_INPUT_BUFSIZE);
+			count_keys(curskey_decode(r->bytes + off, n, &state, keys), arrived);
+		}
+	}
+
+	count_keys(curskey_decode_flush(&state, keys), arrived);
+}
+
+static int replay_pty(const struct record *records, int count) {
+	struct curskey_ctx *ctx = curskey_ctx_new();
+	struct termios tio;
+	int keys[256], timeout;
+	int master, slave, i = 0;
+	size_t written = 0;
+	double t, last_write = 0, pending = 0; // Time of the first write not decoded yet
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (! ctx || master < 0 || grantpt(master) || unlockpt(master)
+			|| (slave = open(ptsname(master), O_RDWR | O_NOCTTY)) < 0)
+		return perror("pty"), 1;
+
+	// Pass the bytes through unchanged
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+	fcntl(master, F_SETFL, O_NONBLOCK);
+
+	set_escdelay(opt_escdelay);
+	curskey_set_input_fd_ctx(ctx, slave);
+	curskey_enable_ctx(ctx, CURSKEY_OPT_DECODER | (opt_adaptive ? CURSKEY_OPT_ADAPTIVE_ESCDELAY : 0));
+
+	t = now_us() + (count ? records[0].delay_us : 0);
+	timeout = -1;
+	while (i < count || timeout >= 0) {
+		struct pollfd pfd[2] = { { slave, POLLIN, 0 }, { master, POLLOUT, 0 } };
+		double wait_ms = timeout;
+
+		// Write the next record when it is due
+		if (i < count) {
+			const double due = (opt_max_speed ? 0 : (t - now_us()) / 1000);
+			if (due <= 0) {
+				ssize_t r = write(master, records[i].bytes + written, records[i].len - written);
+				if (r > 0) {
+					last_write = now_us();
+					if (! pending)
+						pending = last_write;
+					if ((written += r) == records[i].len) {
+						written = 0;
+						if (++i < count)
+							t += records[i].delay_us;
+					}
+				}
+				wait_ms = 0;
+			}
+			else if (wait_ms < 0 || due < wait_ms)
+				wait_ms = due;
+		}
+
+		if (poll(pfd, (i < count ? 2 : 1), (int) wait_ms) > 0 && (pfd[0].revents & POLLIN))
+			curskey_fill_ctx(ctx);
+
+		int n = curskey_drain_ctx(ctx, keys, 256, &timeout);
+		if (n) {
+			// Keys of bytes that were still in the pty count from the last write
+			count_keys(n, (pending ? pending : last_write));
+			pending = 0;
+		}
+	}
+
+	curskey_disable_ctx(ctx, CURSKEY_OPT_DECODER);
+	curskey_ctx_free(ctx);
+	close(slave);
+	close(master);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	struct record *records = NULL;
+	static unsigned char buf[64 * 1024 * 1024];
+	size_t len, bytes = 0;
+	FILE *f;
+	int opt, count;
+	double start, elapsed;
+
+	while ((opt = getopt(argc, argv, "mpae:")) != -1) {
+		switch (opt) {
+		case 'm': opt_max_speed = 1;           break;
+		case 'p': opt_pty = 1;                 break;
+		case 'a': opt_adaptive = 1;            break;
+		case 'e': opt_escdelay = atoi(optarg); break;
+		default:  optind = argc + 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "Usage: %s [-m] [-p [-a]] [-e ESCDELAY] RECORDING\n", argv[0]);
+		return 1;
+	}
+
+	if (! (f = fopen(argv[optind], "rb")))
+		return perror(argv[optind]), 1;
+	len = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+
+	if ((count = parse_recording(buf, len, &records)) < 0) {
+		fprintf(stderr, "%s: not a valid recording\n", argv[optind]);
+		return 1;
+	}
+
+	for (int i = 0; i < count; ++i)
+		bytes += records[i].len;
+
+	start = now_us();
+	if (opt_pty) {
+		if (replay_pty(records, count))
+			return 1;
+	}
+	else
+		replay_headless(records, count);
+	elapsed = now_us() - start;
+
+	printf("records:    %d\n", count);
+	printf("bytes:      %zu\n", bytes);
+	printf("keys:       %ld\n", keys_total);
+	printf("elapsed:    %.3f ms\n", elapsed / 1e3);
+	printf("throughput: %.1f MB/s, %.0f keys/s\n", bytes / elapsed, keys_total / elapsed * 1e6);
+	printf("latency:    %.1f us average, %.1f us max\n",
+		(keys_total ? latency_sum / keys_total : 0), latency_max);
+
+	free(records);
+	return 0;
+}
+
+/* vim: set ts=4 sw=4 : */